@@ -26,7 +26,7 @@ int main()
     val["num1"] = 11;
     val["num2"] = 22;
     rrp->setParms(val);
-    rrp->SetId("1111");
+    rrp->SetId(1111);
     rrp->SetMytype(MType::REQ_RPC);
 
     cout << rrp->check() << endl;
@@ -14,7 +14,7 @@ void onRpcRequest(const BaseConnection::ptr &conn, RpcRequest::ptr &msg)
     Json::Value val;
     val["result"] = "11 + 22 = 33";
     rrs->setResult(val);
-    rrs->SetId("2222");
+    rrs->SetId(2222);
     rrs->SetMytype(MType::RSP_RPC);
     conn->send(rrs);
     LOG(INFO, "成功发送\n");
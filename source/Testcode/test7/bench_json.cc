@@ -0,0 +1,112 @@
+#include "../../common/message.hpp"
+#include <chrono>
+#include <vector>
+
+using namespace util_ns;
+using namespace std;
+
+// json序列化/反序列化的微基准测试
+// legacy: 每次调用都重新构造StreamWriterBuilder/StreamWriter/stringstream/CharReader, 带缩进输出（改造前的实现）
+// cached: JSON::Serialize/UnSerialize, 每个线程复用writer/reader以及输出缓冲区, 紧凑输出
+
+static bool LegacySerialize(const Json::Value &root, std::string &str)
+{
+    Json::StreamWriterBuilder swb;
+    std::unique_ptr<Json::StreamWriter> sw(swb.newStreamWriter());
+    std::stringstream ss;
+    int ret = sw->write(root, &ss);
+    if (ret != 0)
+        return false;
+    str = ss.str();
+    return true;
+}
+
+static bool LegacyUnSerialize(const std::string &str, Json::Value &root)
+{
+    Json::CharReaderBuilder crb;
+    std::unique_ptr<Json::CharReader> cr(crb.newCharReader());
+    return cr->parse(str.c_str(), str.c_str() + str.size(), &root, nullptr);
+}
+
+// 为了拿到各个消息内部的Json::Value，这里通过反序列化取回
+static Json::Value BodyOf(const BaseMessage::ptr &msg)
+{
+    Json::Value body;
+    JSON::UnSerialize(msg->serialize(), body);
+    return body;
+}
+
+static vector<pair<string, Json::Value>> BuildSamples()
+{
+    vector<pair<string, Json::Value>> samples;
+
+    auto rpc_req = MessageFactory::create<RpcRequest>();
+    Json::Value params;
+    params["num1"] = 11;
+    params["num2"] = 22;
+    rpc_req->setMethod("Add");
+    rpc_req->setParms(params);
+    samples.push_back(make_pair("RpcRequest", BodyOf(rpc_req)));
+
+    auto rpc_rsp = MessageFactory::create<RpcResponse>();
+    rpc_rsp->setRCode(RCode::RCODE_OK);
+    rpc_rsp->setResult(33);
+    samples.push_back(make_pair("RpcResponse", BodyOf(rpc_rsp)));
+
+    auto topic_req = MessageFactory::create<TopicRequest>();
+    topic_req->setTopicKey("hello");
+    topic_req->setOptype(TopicOptype::TOPIC_PUBLISH);
+    topic_req->setTopicMsg("Hello World-0");
+    samples.push_back(make_pair("TopicRequest", BodyOf(topic_req)));
+
+    auto topic_rsp = MessageFactory::create<TopicResponse>();
+    topic_rsp->setRCode(RCode::RCODE_OK);
+    samples.push_back(make_pair("TopicResponse", BodyOf(topic_rsp)));
+
+    auto service_req = MessageFactory::create<ServiceRequest>();
+    service_req->setMethod("Add");
+    service_req->setOptype(ServiceOptype::SERVICE_REGISTRY);
+    service_req->setHost(Address("127.0.0.1", 8888));
+    samples.push_back(make_pair("ServiceRequest", BodyOf(service_req)));
+
+    auto service_rsp = MessageFactory::create<ServiceResponse>();
+    service_rsp->setRCode(RCode::RCODE_OK);
+    service_rsp->setOptype(ServiceOptype::SERVICE_DISCOVERY);
+    service_rsp->setMethod("Add");
+    service_rsp->setHost({Address("127.0.0.1", 8888), Address("127.0.0.1", 8889)});
+    samples.push_back(make_pair("ServiceResponse", BodyOf(service_rsp)));
+    return samples;
+}
+
+template <typename F>
+static double NsPerOp(int loops, F f)
+{
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < loops; i++)
+        f();
+    auto end = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::nanoseconds>(end - begin).count() / (double)loops;
+}
+
+int main(int argc, char *argv[])
+{
+    int loops = argc > 1 ? atoi(argv[1]) : 100000;
+    printf("%-16s %8s %8s %12s %12s %12s %12s\n", "message", "old(B)", "new(B)",
+           "old ser(ns)", "new ser(ns)", "old par(ns)", "new par(ns)");
+    for (auto &sample : BuildSamples())
+    {
+        const Json::Value &body = sample.second;
+        string legacy_str, cached_str;
+        LegacySerialize(body, legacy_str);
+        JSON::Serialize(body, cached_str);
+
+        double legacy_ser = NsPerOp(loops, [&]() { string out; LegacySerialize(body, out); });
+        double cached_ser = NsPerOp(loops, [&]() { string out; JSON::Serialize(body, out); });
+        double legacy_par = NsPerOp(loops, [&]() { Json::Value val; LegacyUnSerialize(legacy_str, val); });
+        double cached_par = NsPerOp(loops, [&]() { Json::Value val; JSON::UnSerialize(cached_str, val); });
+
+        printf("%-16s %8zu %8zu %12.0f %12.0f %12.0f %12.0f\n", sample.first.c_str(),
+               legacy_str.size(), cached_str.size(), legacy_ser, cached_ser, legacy_par, cached_par);
+    }
+    return 0;
+}
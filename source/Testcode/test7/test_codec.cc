@@ -0,0 +1,137 @@
+#include "../../common/message.hpp"
+#include "test_util.hpp"
+#include <climits>
+#include <vector>
+
+using namespace util_ns;
+using namespace std;
+using namespace test_util;
+
+// 二进制正文编码(MessagePack)的正确性测试
+// 1. 嵌套的对象/数组、字符串、布尔、null、浮点数编码后再解码，与原值一致
+// 2. 整数的各个边界值（每种编码宽度的上下界、int64/uint64的极值）能够原样还原
+// 3. 嵌套深度超过上限的数据解码失败，不会导致栈溢出
+// 4. 消息按二进制编码序列化后，再按二进制编码反序列化得到相同的正文
+
+// 以json文本比较两个值，用于嵌套结构的整体比较
+static string Text(const Json::Value &val)
+{
+    string str;
+    JSON::Serialize(val, str);
+    return str;
+}
+
+static bool RoundTrip(const Json::Value &in, Json::Value &out)
+{
+    string bin;
+    if (MsgPack::Serialize(in, bin) == false)
+        return false;
+    return MsgPack::UnSerialize(bin, out);
+}
+
+static void TestNested()
+{
+    Json::Value root;
+    root["name"] = "topic.orders";
+    root["flag"] = true;
+    root["none"] = Json::Value();
+    root["ratio"] = 3.25;
+    root["empty_map"] = Json::Value(Json::objectValue);
+    root["empty_arr"] = Json::Value(Json::arrayValue);
+    root["long_str"] = string(70000, 'x'); // str32
+    Json::Value inner;
+    inner["a"]["b"]["c"] = "deep";
+    inner["list"].append(1);
+    inner["list"].append("two");
+    inner["list"].append(Json::Value(Json::objectValue));
+    inner["list"][2]["k"] = false;
+    root["inner"] = inner;
+    for (int i = 0; i < 20; i++) // map16
+    {
+        root["map16"]["key" + to_string(i)] = i;
+    }
+
+    Json::Value out;
+    CHECK(RoundTrip(root, out));
+    CHECK(Text(root) == Text(out));
+    CHECK(out["inner"]["a"]["b"]["c"].asString() == "deep");
+    CHECK(out["long_str"].asString().size() == 70000);
+    CHECK(out["none"].isNull());
+    CHECK(out["empty_map"].isObject() && out["empty_map"].empty());
+    CHECK(out["empty_arr"].isArray() && out["empty_arr"].empty());
+}
+
+static void TestIntegers()
+{
+    vector<Json::Int64> sints = {0, 1, -1, 127, 128, -32, -33, -128, -129, 255, 256, 32767, -32768, -32769,
+                                 65535, 65536, INT_MAX, INT_MIN, (Json::Int64)INT_MAX + 1, (Json::Int64)INT_MIN - 1,
+                                 LLONG_MAX, LLONG_MIN};
+    for (auto v : sints)
+    {
+        Json::Value out;
+        CHECK(RoundTrip(Json::Value(v), out));
+        CHECK(out.isInt64() && out.asInt64() == v);
+    }
+    vector<Json::UInt64> uints = {0xFFull, 0x100ull, 0xFFFFull, 0x10000ull, 0xFFFFFFFFull, 0x100000000ull,
+                                  (Json::UInt64)LLONG_MAX + 1, ULLONG_MAX};
+    for (auto v : uints)
+    {
+        Json::Value out;
+        CHECK(RoundTrip(Json::Value(v), out));
+        CHECK(out.isUInt64() && out.asUInt64() == v);
+    }
+}
+
+static void TestDepth()
+{
+    // 构造depth层嵌套的数组
+    auto nest = [](int depth) {
+        Json::Value root(Json::arrayValue);
+        Json::Value *cur = &root;
+        for (int i = 0; i < depth; i++)
+        {
+            cur->append(Json::Value(Json::arrayValue));
+            cur = &(*cur)[0];
+        }
+        return root;
+    };
+    Json::Value out;
+    CHECK(RoundTrip(nest(32), out));
+    CHECK(RoundTrip(nest(1000), out) == false);
+
+    // 截断的数据解码失败
+    string bin;
+    Json::Value root;
+    root["key"] = "value";
+    CHECK(MsgPack::Serialize(root, bin));
+    CHECK(MsgPack::UnSerialize(bin.data(), bin.size() - 1, out) == false);
+}
+
+static void TestMessage()
+{
+    auto req = MessageFactory::create<RpcRequest>();
+    Json::Value params;
+    params["num1"] = 11;
+    params["num2"] = -22;
+    params["nested"]["list"].append("x");
+    req->setMethod("Add");
+    req->setParms(params);
+
+    string bin = req->serialize(CodecType::CODEC_BINARY);
+    auto out = MessageFactory::create<RpcRequest>();
+    CHECK(out->unserialize(bin.data(), bin.size(), CodecType::CODEC_BINARY));
+    CHECK(out->check());
+    CHECK(out->method() == "Add");
+    CHECK(Text(out->parms()) == Text(params));
+    // 二进制正文比json文本更短
+    CHECK(bin.size() < req->serialize(CodecType::CODEC_JSON).size());
+}
+
+int main()
+{
+    TestNested();
+    TestIntegers();
+    TestDepth();
+    TestMessage();
+    return report("test_codec");
+}
@@ -0,0 +1,113 @@
+#include "../../common/detail.hpp"
+#include "test_util.hpp"
+#include <set>
+
+using namespace util_ns;
+using namespace std;
+using namespace test_util;
+
+// 主题通配符匹配的正确性测试
+// 1. '*'只匹配一级，'#'匹配剩余的零级或多级
+// 2. 通配符只能作为完整的一级，'#'只能出现在最后一级
+// 3. 匹配树的查找结果与逐个模式匹配的结果一致
+// 4. 删除模式后匹配树不再返回它，删除不存在的模式没有影响
+
+static void TestMatch()
+{
+    // '*'匹配恰好一级
+    CHECK(TopicName::match("orders.*", "orders.eu"));
+    CHECK(TopicName::match("orders.*.created", "orders.eu.created"));
+    CHECK(TopicName::match("orders.*", "orders.eu.created") == false);
+    CHECK(TopicName::match("orders.*", "orders") == false);
+    CHECK(TopicName::match("*", "orders"));
+    CHECK(TopicName::match("*", "orders.eu") == false);
+    // '#'匹配零级或多级
+    CHECK(TopicName::match("orders.#", "orders"));
+    CHECK(TopicName::match("orders.#", "orders.eu"));
+    CHECK(TopicName::match("orders.#", "orders.eu.created"));
+    CHECK(TopicName::match("orders.#", "payments.eu") == false);
+    CHECK(TopicName::match("#", "orders.eu.created"));
+    CHECK(TopicName::match("*.#", "orders"));
+    // 没有通配符时完全匹配
+    CHECK(TopicName::match("orders.eu", "orders.eu"));
+    CHECK(TopicName::match("orders.eu", "orders.us") == false);
+    CHECK(TopicName::match("orders", "orders.eu") == false);
+}
+
+static void TestPattern()
+{
+    CHECK(TopicName::isPattern("orders.*"));
+    CHECK(TopicName::isPattern("*.eu"));
+    CHECK(TopicName::isPattern("orders.#"));
+    CHECK(TopicName::isPattern("#"));
+    CHECK(TopicName::isPattern("a.*.b"));
+    // 通配符必须是完整的一级
+    CHECK(TopicName::isPattern("orders") == false);
+    CHECK(TopicName::isPattern("orders.e*") == false);
+    CHECK(TopicName::isPattern("orders.#eu") == false);
+    CHECK(TopicName::isPattern("**") == false);
+    CHECK(TopicName::isPattern("") == false);
+    CHECK(TopicName::isPattern("a..b") == false);
+    // '#'只能出现在最后一级
+    CHECK(TopicName::validPattern("orders.#"));
+    CHECK(TopicName::validPattern("*.eu.*"));
+    CHECK(TopicName::validPattern("#.eu") == false);
+    CHECK(TopicName::validPattern("orders.#.created") == false);
+}
+
+static set<string> TrieMatch(const TopicTrie<string> &trie, const string &name)
+{
+    vector<string> out;
+    trie.match(name, out);
+    return set<string>(out.begin(), out.end());
+}
+
+static void TestTrie()
+{
+    vector<string> patterns = {"orders.*", "orders.#", "orders.eu.created", "*.eu.*", "#", "*", "payments.*.refund",
+                               "*.*", "orders.eu.#"};
+    vector<string> names = {"orders", "orders.eu", "orders.eu.created", "orders.us.created", "payments.eu.refund",
+                            "payments", "a.b.c.d", "x.eu.y"};
+    TopicTrie<string> trie;
+    for (auto &pattern : patterns)
+    {
+        CHECK(trie.insert(pattern, pattern));
+    }
+    // 重复添加被忽略
+    CHECK(trie.insert("orders.*", "orders.*") == false);
+    CHECK(trie.size() == patterns.size());
+    for (auto &name : names)
+    {
+        set<string> expect;
+        for (auto &pattern : patterns)
+        {
+            if (TopicName::match(pattern, name))
+                expect.insert(pattern);
+        }
+        CHECK(TrieMatch(trie, name) == expect);
+    }
+    // 同一个模式的'#'匹配零级时不会被重复返回
+    vector<string> out;
+    trie.match("orders", out);
+    CHECK(count(out.begin(), out.end(), "orders.#") == 1);
+
+    CHECK(trie.remove("orders.#", "orders.#"));
+    CHECK(trie.remove("orders.#", "orders.#") == false);
+    CHECK(trie.remove("not.exist", "not.exist") == false);
+    CHECK(TrieMatch(trie, "orders.eu.created").count("orders.#") == 0);
+    CHECK(TrieMatch(trie, "orders.eu.created").count("orders.eu.#") == 1);
+    for (auto &pattern : patterns)
+    {
+        trie.remove(pattern, pattern);
+    }
+    CHECK(trie.size() == 0);
+    CHECK(TrieMatch(trie, "orders.eu").empty());
+}
+
+int main()
+{
+    TestMatch();
+    TestPattern();
+    TestTrie();
+    return report("test_pattern");
+}
@@ -0,0 +1,148 @@
+#include "../../client/requestor.hpp"
+#include "test_util.hpp"
+
+using namespace util_ns;
+using namespace util_ns::client;
+using namespace std;
+using namespace test_util;
+
+// 分片Requestor在并发发送/完成下的正确性测试
+// 1. 多个线程同时发送请求、多个线程同时完成请求，每个请求的回调恰好执行一次
+// 2. 所有请求完成后，连接上等待响应的请求数量回到0
+// 3. 连接断开时，只有该连接上未完成的请求以RCODE_DISCONNECTED失败，其他连接上的请求不受影响
+// 4. 未知id的响应被忽略
+
+static BaseMessage::ptr Request()
+{
+    auto req = MessageFactory::create<RpcRequest>();
+    req->SetId(IDGenerator::nextId());
+    req->SetMytype(MType::REQ_RPC);
+    req->setMethod("Add");
+    return req;
+}
+
+static BaseMessage::ptr Response(uint64_t rid)
+{
+    auto rsp = MessageFactory::create<RpcResponse>();
+    rsp->SetId(rid);
+    rsp->SetMytype(MType::RSP_RPC);
+    rsp->setRCode(RCode::RCODE_OK);
+    return rsp;
+}
+
+static void TestConcurrentComplete()
+{
+    const int senders = 4, responders = 4, per_sender = 5000;
+    const int total = senders * per_sender;
+    Requestor requestor;
+    auto conn = std::make_shared<FakeConnection>();
+    BaseConnection::ptr base = conn;
+    std::atomic<int> completed{0}, errors{0};
+    std::atomic<bool> sending{true};
+
+    vector<thread> threads;
+    for (int i = 0; i < senders; i++)
+    {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < per_sender; j++)
+            {
+                bool ret = requestor.send(base, Request(), [&](const BaseMessage::ptr &rsp) {
+                    auto jrsp = std::dynamic_pointer_cast<JsonResponse>(rsp);
+                    if (jrsp.get() == nullptr || jrsp->rcode() != RCode::RCODE_OK)
+                        errors++;
+                    completed++;
+                });
+                if (ret == false)
+                    errors++;
+            }
+        });
+    }
+    std::atomic<int> answered{0};
+    for (int i = 0; i < responders; i++)
+    {
+        threads.emplace_back([&]() {
+            while (true)
+            {
+                BaseMessage::ptr req = conn->pop();
+                if (req.get() == nullptr)
+                {
+                    if (sending == false && answered == total)
+                        break;
+                    this_thread::yield();
+                    continue;
+                }
+                BaseMessage::ptr rsp = Response(req->rid());
+                requestor.onResponse(base, rsp);
+                answered++;
+            }
+        });
+    }
+    for (int i = 0; i < senders; i++)
+        threads[i].join();
+    sending = false;
+    for (size_t i = senders; i < threads.size(); i++)
+        threads[i].join();
+
+    CHECK(errors == 0);
+    CHECK(completed == total);
+    CHECK(conn->inflight() == 0);
+    CHECK(conn->takePending().empty());
+
+    // 重复的响应被忽略，回调不会再次执行
+    BaseMessage::ptr dup = Response(1);
+    requestor.onResponse(base, dup);
+    CHECK(completed == total);
+}
+
+static void TestClose()
+{
+    Requestor requestor;
+    auto conn1 = std::make_shared<FakeConnection>();
+    auto conn2 = std::make_shared<FakeConnection>();
+    BaseConnection::ptr base1 = conn1, base2 = conn2;
+    const int count = 100;
+    vector<Requestor::AsyncResponse> rsp1(count), rsp2(count);
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(requestor.send(base1, Request(), rsp1[i]));
+        CHECK(requestor.send(base2, Request(), rsp2[i]));
+    }
+    CHECK(conn1->inflight() == count && conn2->inflight() == count);
+    // 连接1上的一半请求先收到了响应
+    for (int i = 0; i < count / 2; i++)
+    {
+        BaseMessage::ptr rsp = Response(conn1->pop()->rid());
+        requestor.onResponse(base1, rsp);
+    }
+    conn1->shutdown();
+    requestor.onClose(base1);
+    CHECK(conn1->inflight() == 0);
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(rsp1[i].wait_for(chrono::seconds(0)) == future_status::ready);
+        auto rsp = std::dynamic_pointer_cast<JsonResponse>(rsp1[i].get());
+        CHECK(rsp.get() != nullptr);
+        if (rsp.get() == nullptr)
+            continue;
+        if (i < count / 2)
+            CHECK(rsp->rcode() == RCode::RCODE_OK);
+        else
+            CHECK(rsp->rcode() == RCode::RCODE_DISCONNECTED);
+    }
+    // 连接2上的请求不受影响
+    CHECK(conn2->inflight() == count);
+    for (int i = 0; i < count; i++)
+    {
+        CHECK(rsp2[i].wait_for(chrono::seconds(0)) == future_status::timeout);
+    }
+    // 已断开的连接上不能再发送请求
+    Requestor::AsyncResponse closed;
+    CHECK(requestor.send(base1, Request(), closed) == false);
+}
+
+int main()
+{
+    TestConcurrentComplete();
+    TestClose();
+    return report("test_requestor");
+}
@@ -0,0 +1,94 @@
+#include "../../server/rpc_server.hpp"
+#include "test_util.hpp"
+#include <future>
+#include <signal.h>
+#include <sys/wait.h>
+
+using namespace util_ns;
+using namespace std;
+using namespace test_util;
+
+// 服务提供者下线时，等待中的rpc请求不会一直阻塞
+// 注册中心、服务提供者、以及替服务提供者注册服务的注册客户端分别运行在子进程中
+// 杀死注册客户端后，注册中心通知服务下线，客户端删除唯一的连接池，但与服务提供者之间的TCP连接并没有断开：
+// 1. 连接池删除后，超时时间轮仍然继续推进，请求最迟在超时后结束
+// 2. 连接池删除时，连接上等待响应的请求立即以连接断开结束，不需要等到超时
+
+static const int registryPort = 19899;
+static const int providerPort = 19888;
+static const int callTimeoutMs = 3000;
+
+// 服务提供者收到请求后不响应
+static void Slow(const Json::Value &, Json::Value &result)
+{
+    sleep(60);
+    result = 0;
+}
+
+static pid_t Spawn(const function<void()> &fn)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        fn();
+        _exit(0);
+    }
+    return pid;
+}
+
+static void Stop(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+int main()
+{
+    // 在创建任何线程之前启动子进程
+    pid_t registry = Spawn([]() {
+        server::RegistryServer server(registryPort);
+        server.start();
+    });
+    pid_t provider = Spawn([]() {
+        std::unique_ptr<server::SDescribeFactory> factory(new server::SDescribeFactory());
+        factory->setMethodName("Slow");
+        factory->setReturnType(server::VType::INTEGRAL);
+        factory->setCallback(Slow);
+        server::RpcServer server(Address("127.0.0.1", providerPort));
+        server.registerMethod(factory->build());
+        server.start();
+    });
+    sleepMs(300);
+    pid_t announcer = Spawn([]() {
+        client::ReigstryClient reg_client("127.0.0.1", registryPort);
+        reg_client.registryMethod("Slow", Address("127.0.0.1", providerPort));
+        pause();
+    });
+    sleepMs(300);
+
+    auto client = std::make_shared<client::RpcClient>(true, "127.0.0.1", registryPort);
+    auto done = std::make_shared<promise<bool>>();
+    future<bool> result = done->get_future();
+    thread([client, done]() {
+        Json::Value ret;
+        done->set_value(client->call("Slow", Json::Value(Json::objectValue), ret, callTimeoutMs));
+    }).detach();
+    sleepMs(500);
+    CHECK(result.wait_for(chrono::seconds(0)) == future_status::timeout);
+
+    // 服务提供者从注册中心下线，客户端删除唯一的连接池
+    Stop(announcer);
+    // 连接池删除时请求立即结束，远早于超时
+    CHECK(result.wait_for(chrono::milliseconds(callTimeoutMs / 2)) == future_status::ready);
+    bool ready = result.wait_for(chrono::milliseconds(callTimeoutMs + 2000)) == future_status::ready;
+    CHECK(ready);
+    if (ready)
+        CHECK(result.get() == false);
+
+    Stop(provider);
+    Stop(registry);
+    int code = report("test_rpc_offline");
+    fflush(stdout);
+    // 失败时发起请求的线程可能仍然阻塞，不等待它退出
+    _exit(code);
+}
@@ -0,0 +1,84 @@
+#include "../../common/timewheel.hpp"
+#include "test_util.hpp"
+#include <set>
+
+using namespace util_ns;
+using namespace std;
+using namespace test_util;
+
+// 时间轮的正确性测试
+// 1. 任务在到期之前不会触发，到期后推进一次即触发，且只触发一次
+// 2. 取消的任务不会触发，并且立即从时间轮中摘除
+// 3. 节点复用后，旧句柄的取消不会影响新任务
+// 4. 超过一圈的任务不会在第一圈提前触发
+
+static void TestExpire()
+{
+    multiset<uint64_t> fired;
+    TimeWheel wheel([&fired](uint64_t id) { fired.insert(id); }, 10, 16);
+    wheel.add(1, 30);
+    wheel.add(2, 100);
+    wheel.advance();
+    CHECK(fired.empty());
+    sleepMs(60);
+    wheel.advance();
+    CHECK(fired.count(1) == 1 && fired.count(2) == 0);
+    sleepMs(80);
+    wheel.advance();
+    wheel.advance();
+    CHECK(fired.count(1) == 1 && fired.count(2) == 1);
+    CHECK(wheel.size() == 0);
+}
+
+static void TestCancel()
+{
+    multiset<uint64_t> fired;
+    TimeWheel wheel([&fired](uint64_t id) { fired.insert(id); }, 10, 16);
+    TimeWheel::Handle h1 = wheel.add(1, 20);
+    TimeWheel::Handle h2 = wheel.add(2, 20);
+    wheel.add(3, 20);
+    CHECK(wheel.size() == 3);
+    wheel.cancel(h1, 1);
+    wheel.cancel(h2, 2);
+    CHECK(wheel.size() == 1);
+    // 重复取消无影响
+    wheel.cancel(h1, 1);
+    CHECK(wheel.size() == 1);
+    // 节点被新任务复用后，旧句柄的取消被忽略
+    TimeWheel::Handle h4 = wheel.add(4, 20);
+    CHECK(h4 == h2 || h4 == h1);
+    wheel.cancel(h4 == h2 ? h2 : h1, h4 == h2 ? 2 : 1);
+    CHECK(wheel.size() == 2);
+    sleepMs(50);
+    wheel.advance();
+    CHECK(fired.count(1) == 0 && fired.count(2) == 0);
+    CHECK(fired.count(3) == 1 && fired.count(4) == 1);
+    // 已经到期的任务取消无影响
+    wheel.cancel(h4, 4);
+    CHECK(wheel.size() == 0);
+}
+
+static void TestLap()
+{
+    multiset<uint64_t> fired;
+    // 8个槽位 * 10ms = 80ms 一圈
+    TimeWheel wheel([&fired](uint64_t id) { fired.insert(id); }, 10, 8);
+    wheel.add(1, 150);
+    for (int i = 0; i < 10; i++)
+    {
+        sleepMs(10);
+        wheel.advance();
+    }
+    CHECK(fired.empty());
+    sleepMs(100);
+    wheel.advance();
+    CHECK(fired.count(1) == 1);
+}
+
+int main()
+{
+    TestExpire();
+    TestCancel();
+    TestLap();
+    return report("test_timewheel");
+}
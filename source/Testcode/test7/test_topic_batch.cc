@@ -0,0 +1,161 @@
+#include "../../server/rpc_topic.hpp"
+#include "test_util.hpp"
+
+using namespace util_ns;
+using namespace util_ns::server;
+using namespace std;
+using namespace test_util;
+
+// 批量发布/订阅的正确性测试，直接驱动服务端的主题管理，不经过网络
+// 1. 批量发布只发送一个响应，响应中按条目顺序携带每条消息的偏移量
+// 2. 批量发布中任何一个主题不存在时整批拒绝，不发布其中的任何消息
+// 3. 批量订阅中任何一个主题不存在时整批拒绝，不订阅其中的任何主题，全部存在时全部订阅
+// 4. 持久化主题的批量发布在落盘之后才发送响应
+
+static TopicRequest::ptr Request(const string &key, TopicOptype type)
+{
+    auto req = MessageFactory::create<TopicRequest>();
+    req->SetMytype(MType::REQ_TOPIC);
+    req->SetId(IDGenerator::nextId());
+    req->setOptype(type);
+    req->setTopicKey(key);
+    return req;
+}
+
+static bool Create(TopicManager &manager, const FakeConnection::ptr &conn, const string &key, bool durable = false)
+{
+    auto req = Request(key, TopicOptype::TOPIC_CREATE);
+    if (durable)
+        req->setDurable(true);
+    manager.onTopicRequest(conn, req);
+    TopicResponse::ptr rsp = conn->popAs<TopicResponse>();
+    return rsp && rsp->rcode() == RCode::RCODE_OK;
+}
+
+static uint64_t Publish(TopicManager &manager, const FakeConnection::ptr &conn, const string &key)
+{
+    auto req = Request(key, TopicOptype::TOPIC_PUBLISH);
+    req->setTopicMsg("hello");
+    manager.onTopicRequest(conn, req);
+    TopicResponse::ptr rsp = conn->popAs<TopicResponse>();
+    if (!rsp || rsp->rcode() != RCode::RCODE_OK)
+        return (uint64_t)-1;
+    return rsp->offset();
+}
+
+static TopicRequest::ptr PublishBatch(const vector<string> &keys)
+{
+    auto req = Request("", TopicOptype::TOPIC_PUBLISH_BATCH);
+    for (auto &key : keys)
+    {
+        req->appendPublish(key, "msg-" + key);
+    }
+    return req;
+}
+
+static TopicRequest::ptr SubscribeBatch(const vector<string> &keys)
+{
+    auto req = Request("", TopicOptype::TOPIC_SUBSCRIBE_BATCH);
+    for (auto &key : keys)
+    {
+        req->appendSubscribe(key);
+    }
+    return req;
+}
+
+static void TestPublishBatch()
+{
+    TopicManager manager;
+    auto conn = std::make_shared<FakeConnection>();
+    CHECK(Create(manager, conn, "a"));
+    CHECK(Create(manager, conn, "b"));
+
+    auto req = PublishBatch({"a", "b", "a", "b", "a"});
+    CHECK(req->check());
+    manager.onTopicRequest(conn, req);
+    CHECK(conn->sentCount() == 1);
+    TopicResponse::ptr rsp = conn->popAs<TopicResponse>();
+    CHECK(rsp && rsp->rcode() == RCode::RCODE_OK && rsp->rid() == req->rid());
+    if (rsp)
+        CHECK(rsp->offsets() == vector<uint64_t>({0, 0, 1, 1, 2}));
+
+    // 有一个主题不存在，整批拒绝
+    manager.onTopicRequest(conn, PublishBatch({"a", "missing", "b"}));
+    rsp = conn->popAs<TopicResponse>();
+    CHECK(rsp && rsp->rcode() == RCode::RCODE_NOT_FOUND_TOPIC);
+    CHECK(conn->sentCount() == 0);
+    CHECK(Publish(manager, conn, "a") == 3);
+    CHECK(Publish(manager, conn, "b") == 2);
+
+    // 空的批量请求直接成功
+    manager.onTopicRequest(conn, PublishBatch({}));
+    rsp = conn->popAs<TopicResponse>();
+    CHECK(rsp && rsp->rcode() == RCode::RCODE_OK);
+}
+
+static void TestSubscribeBatch()
+{
+    TopicManager manager;
+    auto publisher = std::make_shared<FakeConnection>();
+    auto subscriber = std::make_shared<FakeConnection>();
+    CHECK(Create(manager, publisher, "a"));
+    CHECK(Create(manager, publisher, "b"));
+    CHECK(Create(manager, publisher, "c.d"));
+
+    // 有一个主题不存在，整批拒绝，其他主题也没有订阅
+    manager.onTopicRequest(subscriber, SubscribeBatch({"a", "missing", "c.#"}));
+    TopicResponse::ptr rsp = subscriber->popAs<TopicResponse>();
+    CHECK(rsp && rsp->rcode() == RCode::RCODE_NOT_FOUND_TOPIC);
+    Publish(manager, publisher, "a");
+    Publish(manager, publisher, "c.d");
+    CHECK(subscriber->rawCount() == 0);
+
+    // 非法的模式同样整批拒绝
+    manager.onTopicRequest(subscriber, SubscribeBatch({"a", "#.d"}));
+    rsp = subscriber->popAs<TopicResponse>();
+    CHECK(rsp && rsp->rcode() == RCode::RCODE_INVALID_PARAMS);
+    Publish(manager, publisher, "a");
+    CHECK(subscriber->rawCount() == 0);
+
+    // 全部存在时全部订阅，只发送一个响应
+    manager.onTopicRequest(subscriber, SubscribeBatch({"a", "b", "c.#"}));
+    CHECK(subscriber->sentCount() == 1);
+    rsp = subscriber->popAs<TopicResponse>();
+    CHECK(rsp && rsp->rcode() == RCode::RCODE_OK);
+    Publish(manager, publisher, "a");
+    Publish(manager, publisher, "b");
+    Publish(manager, publisher, "c.d");
+    CHECK(subscriber->rawCount() == 3);
+}
+
+static void TestDurableBatch()
+{
+    string dir = tempDir("test_topic_batch");
+    CHECK(dir.empty() == false);
+    if (dir.empty())
+        return;
+    {
+        TopicManager manager;
+        manager.enableDurable(std::make_shared<TopicStore>(dir));
+        auto conn = std::make_shared<FakeConnection>();
+        CHECK(Create(manager, conn, "orders", true));
+        CHECK(Create(manager, conn, "memory"));
+        auto req = PublishBatch({"orders", "memory", "orders"});
+        manager.onTopicRequest(conn, req);
+        // 持久化主题的消息落盘之后才响应，由组提交线程发送
+        TopicResponse::ptr rsp = conn->popAs<TopicResponse>(1000);
+        CHECK(rsp && rsp->rcode() == RCode::RCODE_OK && rsp->rid() == req->rid());
+        if (rsp)
+            CHECK(rsp->offsets() == vector<uint64_t>({0, 0, 1}));
+        CHECK(conn->sentCount() == 0);
+    }
+    removeDir(dir);
+}
+
+int main()
+{
+    TestPublishBatch();
+    TestSubscribeBatch();
+    TestDurableBatch();
+    return report("test_topic_batch");
+}
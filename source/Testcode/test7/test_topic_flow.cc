@@ -0,0 +1,117 @@
+#include "../../server/rpc_topic.hpp"
+#include "test_util.hpp"
+
+using namespace util_ns;
+using namespace util_ns::server;
+using namespace std;
+using namespace test_util;
+
+// 订阅者等待队列的流量控制测试，直接驱动服务端的主题管理，不经过网络
+// 订阅者的连接不可写时消息进入等待队列，每个主题的队列上限和处理策略只作用于该主题自己的消息
+// 1. DROP_OLDEST只丢弃同一主题最早的消息，DROP_NEWEST只丢弃同一主题的新消息
+// 2. 其他主题的积压不会让BLOCK策略的主题拒绝发布，BLOCK主题自己积压满后拒绝发布，发送完后恢复
+
+static TopicRequest::ptr Request(const string &key, TopicOptype type)
+{
+    auto req = MessageFactory::create<TopicRequest>();
+    req->SetMytype(MType::REQ_TOPIC);
+    req->SetId(IDGenerator::nextId());
+    req->setOptype(type);
+    req->setTopicKey(key);
+    return req;
+}
+
+static bool Create(TopicManager &manager, const FakeConnection::ptr &conn, const string &key, TopicPolicy policy, size_t queue_size)
+{
+    auto req = Request(key, TopicOptype::TOPIC_CREATE);
+    req->setPolicy(policy);
+    req->setQueueSize(queue_size);
+    manager.onTopicRequest(conn, req);
+    TopicResponse::ptr rsp = conn->popAs<TopicResponse>();
+    return rsp && rsp->rcode() == RCode::RCODE_OK;
+}
+
+static bool Subscribe(TopicManager &manager, const FakeConnection::ptr &conn, const string &key)
+{
+    manager.onTopicRequest(conn, Request(key, TopicOptype::TOPIC_SUBSCRIBE));
+    TopicResponse::ptr rsp = conn->popAs<TopicResponse>();
+    return rsp && rsp->rcode() == RCode::RCODE_OK;
+}
+
+static RCode Publish(TopicManager &manager, const FakeConnection::ptr &conn, const string &key)
+{
+    auto req = Request(key, TopicOptype::TOPIC_PUBLISH);
+    req->setTopicMsg("hello");
+    manager.onTopicRequest(conn, req);
+    TopicResponse::ptr rsp = conn->popAs<TopicResponse>();
+    return rsp ? rsp->rcode() : RCode::RCODE_INTERNAL_ERROR;
+}
+
+static void TestDropPolicies()
+{
+    TopicManager manager;
+    auto publisher = std::make_shared<FakeConnection>();
+    auto subscriber = std::make_shared<FakeConnection>();
+    CHECK(Create(manager, publisher, "oldest", TopicPolicy::POLICY_DROP_OLDEST, 2));
+    CHECK(Create(manager, publisher, "newest", TopicPolicy::POLICY_DROP_NEWEST, 3));
+    CHECK(Subscribe(manager, subscriber, "oldest"));
+    CHECK(Subscribe(manager, subscriber, "newest"));
+
+    subscriber->setWritable(false);
+    for (int i = 0; i < 3; i++)
+    {
+        CHECK(Publish(manager, publisher, "newest") == RCode::RCODE_OK);
+    }
+    // 另一个主题已经积压了3条，仍然按自己的上限排队
+    CHECK(Publish(manager, publisher, "oldest") == RCode::RCODE_OK);
+    CHECK(Publish(manager, publisher, "oldest") == RCode::RCODE_OK);
+    CHECK(manager.dropped("oldest") == 0);
+    CHECK(manager.dropped("newest") == 0);
+    // 队列满后只丢弃本主题的消息
+    CHECK(Publish(manager, publisher, "oldest") == RCode::RCODE_OK);
+    CHECK(Publish(manager, publisher, "newest") == RCode::RCODE_OK);
+    CHECK(manager.dropped("oldest") == 1);
+    CHECK(manager.dropped("newest") == 1);
+    CHECK(subscriber->rawCount() == 0);
+
+    subscriber->setWritable(true);
+    CHECK(subscriber->rawCount() == 5);
+}
+
+static void TestBlockPolicy()
+{
+    TopicManager manager;
+    auto publisher = std::make_shared<FakeConnection>();
+    auto subscriber = std::make_shared<FakeConnection>();
+    CHECK(Create(manager, publisher, "bulk", TopicPolicy::POLICY_DROP_OLDEST, 8));
+    CHECK(Create(manager, publisher, "block", TopicPolicy::POLICY_BLOCK, 2));
+    CHECK(Subscribe(manager, subscriber, "bulk"));
+    CHECK(Subscribe(manager, subscriber, "block"));
+
+    subscriber->setWritable(false);
+    for (int i = 0; i < 5; i++)
+    {
+        CHECK(Publish(manager, publisher, "bulk") == RCode::RCODE_OK);
+    }
+    // 其他主题的积压不会阻塞发布
+    CHECK(Publish(manager, publisher, "block") == RCode::RCODE_OK);
+    CHECK(Publish(manager, publisher, "block") == RCode::RCODE_OK);
+    // 本主题积压满后，已经通过检查的消息仍然排队，之后的发布被拒绝
+    CHECK(Publish(manager, publisher, "block") == RCode::RCODE_OK);
+    CHECK(Publish(manager, publisher, "block") == RCode::RCODE_SERVER_BUSY);
+    CHECK(Publish(manager, publisher, "bulk") == RCode::RCODE_OK);
+    CHECK(manager.dropped("bulk") == 0);
+    CHECK(manager.dropped("block") == 0);
+
+    subscriber->setWritable(true);
+    CHECK(subscriber->rawCount() == 9);
+    CHECK(Publish(manager, publisher, "block") == RCode::RCODE_OK);
+    CHECK(subscriber->rawCount() == 10);
+}
+
+int main()
+{
+    TestDropPolicies();
+    TestBlockPolicy();
+    return report("test_topic_flow");
+}
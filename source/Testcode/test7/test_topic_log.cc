@@ -0,0 +1,182 @@
+#include "../../server/rpc_topic_log.hpp"
+#include "test_util.hpp"
+
+using namespace util_ns;
+using namespace util_ns::server;
+using namespace std;
+using namespace test_util;
+
+// 持久化主题日志的正确性测试
+// 1. 重新打开日志后，之前写入的消息能够按偏移量原样回放，之后的消息接着写入
+// 2. 组提交后按偏移量顺序执行等待落盘的回调
+// 3. 崩溃时没有写完的尾部记录（文件被截断、报文不完整）在恢复时被丢弃，之前的记录不受影响
+// 4. 超过保留大小的旧段被删除，当前写入的段保留
+
+// 构造一个LV格式的报文：|--len 4B--|--body--|
+static string MakeFrame(uint64_t offset, size_t body_len = 16)
+{
+    string body = to_string(offset);
+    body.resize(body_len, '.');
+    int32_t be_len = htonl((int32_t)body.size());
+    return string((const char *)&be_len, 4) + body;
+}
+
+static string SegmentPath(const string &dir, uint64_t base)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu.log", (unsigned long long)base);
+    return dir + "/" + name;
+}
+
+// 检查[start, end)之间的消息与写入时一致
+static bool ReadAll(const TopicLog::ptr &log, uint64_t start, uint64_t end, size_t body_len = 16)
+{
+    uint64_t expect = start;
+    bool ok = true;
+    log->read(start, end, [&](uint64_t offset, const char *frame, size_t len) {
+        if (offset != expect || string(frame, len) != MakeFrame(offset, body_len))
+            ok = false;
+        expect++;
+        return true;
+    });
+    return ok && expect == end;
+}
+
+static void TestReplay()
+{
+    string dir = tempDir("test_topic_log");
+    CHECK(dir.empty() == false);
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 0);
+        vector<uint64_t> committed;
+        for (uint64_t i = 0; i < 100; i++)
+        {
+            string frame = MakeFrame(i);
+            CHECK(log->append(i, frame.data(), frame.size()));
+            log->commit(i, [&committed, i]() { committed.push_back(i); });
+        }
+        CHECK(committed.empty());
+        CHECK(log->sync());
+        CHECK(committed.size() == 100);
+        for (size_t i = 0; i < committed.size(); i++)
+        {
+            CHECK(committed[i] == i);
+        }
+    }
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 100 && log->firstOffset() == 0);
+        CHECK(ReadAll(log, 0, 100));
+        // 从中间开始回放
+        CHECK(ReadAll(log, 42, 100));
+        for (uint64_t i = 100; i < 150; i++)
+        {
+            string frame = MakeFrame(i);
+            CHECK(log->append(i, frame.data(), frame.size()));
+        }
+        CHECK(log->sync());
+    }
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 150);
+        CHECK(ReadAll(log, 0, 150));
+    }
+    removeDir(dir);
+}
+
+static void TestTruncatedTail()
+{
+    // 报文16字节，每条记录 24 + 4 + 16 = 44 字节
+    const size_t record = LogSegment::headerLength + 20;
+    string dir = tempDir("test_topic_log");
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        for (uint64_t i = 0; i < 10; i++)
+        {
+            string frame = MakeFrame(i);
+            CHECK(log->append(i, frame.data(), frame.size()));
+        }
+        CHECK(log->sync());
+    }
+    // 崩溃时第9条记录只写了一半
+    string path = SegmentPath(dir, 0);
+    CHECK(truncate(path.c_str(), 8 * record + 25) == 0);
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 8);
+        CHECK(ReadAll(log, 0, 8));
+    }
+    // 第8条记录的长度都已经写入，但报文正文没有写完
+    int fd = ::open(path.c_str(), O_RDWR);
+    CHECK(fd >= 0);
+    char torn[4] = {'x', 'x', 'x', 'x'};
+    CHECK(pwrite(fd, torn, 4, 7 * record + LogSegment::headerLength + 4 + 8) == 4);
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 7);
+        CHECK(ReadAll(log, 0, 7));
+    }
+    // 第6条记录的长度字段已经写入，但报文没有写完
+    char zero[4] = {0};
+    CHECK(pwrite(fd, zero, 4, 5 * record + LogSegment::headerLength) == 4);
+    close(fd);
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 5);
+        CHECK(ReadAll(log, 0, 5));
+        // 恢复后接着写入，新的消息写入新的段
+        for (uint64_t i = 5; i < 12; i++)
+        {
+            string frame = MakeFrame(i);
+            CHECK(log->append(i, frame.data(), frame.size()));
+        }
+        CHECK(log->sync());
+    }
+    {
+        auto log = TopicLog::open(dir, LogOptions(), nullptr);
+        CHECK(log && log->nextOffset() == 12);
+        CHECK(ReadAll(log, 0, 12));
+    }
+    removeDir(dir);
+}
+
+static void TestRetention()
+{
+    LogOptions options;
+    options.segment_bytes = 4096;
+    options.retention_bytes = 8192;
+    options.retention_ms = 0;
+    const size_t body_len = 1000;
+    string dir = tempDir("test_topic_log");
+    auto log = TopicLog::open(dir, options, nullptr);
+    for (uint64_t i = 0; i < 40; i++)
+    {
+        string frame = MakeFrame(i, body_len);
+        CHECK(log->append(i, frame.data(), frame.size()));
+    }
+    CHECK(log->sync());
+    CHECK(log->firstOffset() == 0);
+    log->expire();
+    uint64_t first = log->firstOffset();
+    CHECK(first > 0);
+    CHECK(log->nextOffset() == 40);
+    // 保留的数据不超过保留大小，加上当前写入的段
+    size_t records = log->nextOffset() - first;
+    CHECK(records * (LogSegment::headerLength + 4 + body_len) <= options.retention_bytes + options.segment_bytes);
+    CHECK(ReadAll(log, first, 40, body_len));
+    // 被删除的段文件已经不存在
+    CHECK(access(SegmentPath(dir, 0).c_str(), F_OK) != 0);
+    log.reset();
+    log = TopicLog::open(dir, options, nullptr);
+    CHECK(log && log->firstOffset() == first && log->nextOffset() == 40);
+    removeDir(dir);
+}
+
+int main()
+{
+    TestReplay();
+    TestTruncatedTail();
+    TestRetention();
+    return report("test_topic_log");
+}
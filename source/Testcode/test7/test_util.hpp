@@ -0,0 +1,169 @@
+#pragma once
+#include "../../common/message.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <thread>
+#include <chrono>
+
+// test7中各个测试程序共用的检查宏和测试工具
+
+namespace test_util
+{
+    static int failed = 0; // 失败的检查数量
+
+    // 输出测试结果，返回进程的退出码
+    static int report(const char *name)
+    {
+        if (failed > 0)
+        {
+            printf("%s: %d checks failed\n", name, failed);
+            return 1;
+        }
+        printf("%s: all checks passed\n", name);
+        return 0;
+    }
+
+    static void sleepMs(int ms)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+
+    // 在/tmp下创建一个临时目录，失败时返回空字符串
+    static std::string tempDir(const std::string &prefix)
+    {
+        std::string tmpl = "/tmp/" + prefix + "_XXXXXX";
+        std::vector<char> buf(tmpl.begin(), tmpl.end());
+        buf.push_back('\0');
+        char *dir = mkdtemp(buf.data());
+        return dir == nullptr ? std::string() : std::string(dir);
+    }
+
+    static void removeDir(const std::string &dir)
+    {
+        std::string cmd = "rm -rf " + dir;
+        if (system(cmd.c_str()) != 0)
+            printf("清理目录 %s 失败\n", dir.c_str());
+    }
+
+    // 不进行网络通信的连接，记录发送出去的消息和编码好的报文
+    class FakeConnection : public util_ns::BaseConnection
+    {
+    public:
+        using ptr = std::shared_ptr<FakeConnection>;
+
+        virtual void send(const util_ns::BaseMessage::ptr &msg) override
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _sent.push_back(msg);
+        }
+        virtual void sendRaw(const util_ns::Frame &) override
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _raw++;
+        }
+        virtual void shutdown() override
+        {
+            _connected = false;
+        }
+        virtual bool connected() override
+        {
+            return _connected;
+        }
+        virtual void setCodec(util_ns::CodecType codec) override
+        {
+            _codec = codec;
+        }
+        virtual util_ns::CodecType codec() override
+        {
+            return _codec;
+        }
+        virtual void flush() override {}
+        virtual bool inLoopThread() override
+        {
+            return false;
+        }
+        virtual bool writable() override
+        {
+            return _writable;
+        }
+        virtual void setWritableCallback(const std::function<void()> &cb) override
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cb_writable = cb;
+        }
+
+        // 模拟输出缓冲区超过高水位/积压的数据发送完，重新可写时调用可写回调
+        void setWritable(bool writable)
+        {
+            _writable = writable;
+            std::function<void()> cb;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                cb = _cb_writable;
+            }
+            if (writable && cb)
+                cb();
+        }
+
+        // 取出最早发送的一条消息，没有时最多等待wait_ms毫秒，仍然没有则返回空
+        util_ns::BaseMessage::ptr pop(int wait_ms = 0)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (_sent.empty() == false)
+                    {
+                        util_ns::BaseMessage::ptr msg = _sent.front();
+                        _sent.pop_front();
+                        return msg;
+                    }
+                }
+                if (std::chrono::steady_clock::now() >= deadline)
+                    return util_ns::BaseMessage::ptr();
+                sleepMs(1);
+            }
+        }
+
+        template <typename T>
+        std::shared_ptr<T> popAs(int wait_ms = 0)
+        {
+            return std::dynamic_pointer_cast<T>(pop(wait_ms));
+        }
+
+        // 还没有取出的消息数量
+        size_t sentCount()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _sent.size();
+        }
+
+        // 发送的编码好的报文数量（主题推送）
+        size_t rawCount()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            return _raw;
+        }
+
+    private:
+        std::atomic<bool> _connected{true};
+        std::atomic<bool> _writable{true};
+        std::atomic<util_ns::CodecType> _codec{util_ns::CodecType::CODEC_JSON};
+        std::mutex _mutex;
+        std::deque<util_ns::BaseMessage::ptr> _sent;
+        size_t _raw = 0;
+        std::function<void()> _cb_writable;
+    };
+};
+
+#define CHECK(cond)                                                           \
+    do                                                                        \
+    {                                                                         \
+        if (!(cond))                                                          \
+        {                                                                     \
+            printf("[FAIL] %s:%d: %s\n", __FILE__, __LINE__, #cond);          \
+            test_util::failed++;                                              \
+        }                                                                     \
+    } while (0)
@@ -1,7 +1,9 @@
 #pragma once
 #include "../common/net.hpp"
 #include "../common/message.hpp"
+#include "../common/timewheel.hpp"
 #include <future>
+#include <vector>
 #include <functional>
 
 namespace util_ns
@@ -20,77 +22,122 @@ namespace util_ns
             using ptr = std::shared_ptr<Requestor>;
             using RequestCallback = std::function<void(const BaseMessage::ptr&)>;   // 回调处理响应的回调方法
             using AsyncResponse = std::future<BaseMessage::ptr>;    // ....
+            // 请求的默认超时时间(ms)，小于等于0表示不设置超时
+            static const int defaultTimeout = 10000;
             // 对请求的描述
             struct RequestDescribe
             {
                 using ptr = std::shared_ptr<RequestDescribe>;
                 BaseMessage::ptr request;       // 请求本身
+                BaseConnection::ptr conn;       // 发送请求的连接，用于连接断开时查找该连接上的请求，以及维护连接的负载
                 RType rtype;                    // 处理响应方法：异步还是回调
                 std::promise<BaseMessage::ptr> response;    // 用于异步结果传递
                 RequestCallback callback;       // 回调函数
+                TimeWheel::Handle timer = nullptr; // 超时任务的句柄，请求完成时从时间轮中取消
             };
             
         private:
-            std::mutex _mutex;
-            std::unordered_map<std::string, RequestDescribe::ptr> _request_desc;
+            // 未完成的请求按id分片管理，每个分片有自己的锁和内存池，减少多线程发送请求时的锁竞争
+            static const size_t shardCount = 32;
+            struct Shard
+            {
+                std::mutex _mutex;
+                std::unordered_map<uint64_t, RequestDescribe::ptr> requests;   // 请求id与请求描述的映射
+                BlockPool::ptr pool = std::make_shared<BlockPool>();         // 请求描述对象的内存池
+            };
+            Shard _shards[shardCount];
+            // 请求超时管理，时间轮由客户端所在的EventLoop周期性推进
+            TimeWheel _wheel;
         public:
-            // 针对响应的处理
-            // 第一个参数是连接，第二个参数输入型参数，是响应信息
-            void onResponse(const BaseConnection::ptr& conn, BaseMessage::ptr& msg)
+            Requestor()
+                : _wheel(std::bind(&Requestor::onTimeout, this, std::placeholders::_1))
+            {}
+
+            // 推进超时时间轮，由客户端的定时回调驱动
+            void onTick()
             {
-                std::string rid = msg->rid();
-                RequestDescribe::ptr rdp = getDescribe(msg->rid());
-                if(rdp == RequestDescribe::ptr())
+                _wheel.advance();
+            }
+
+            // 连接断开时，该连接上所有未完成的请求都不会再收到响应了，立即以RCODE_DISCONNECTED完成它们
+            // 上层可以马上换一个服务提供者重试，而不需要等到超时
+            // 连接上维护了等待响应的请求id，只处理这些请求，不需要遍历所有分片
+            void onClose(const BaseConnection::ptr& conn)
+            {
+                std::vector<RequestDescribe::ptr> closed;
+                for(uint64_t rid : conn->takePending())
                 {
-                    LOG(FATAL, "收到响应 - %s，但是未找到对应的请求描述类!\n", rid.c_str());
-                    return;
+                    // 可能已经被响应或超时取走了
+                    RequestDescribe::ptr rdp = takeDescribe(rid);
+                    if(rdp)
+                        closed.push_back(std::move(rdp));
                 }
-                // 如果设置的是异步处理
-                if(rdp->rtype == RType::REQ_ASYNC)
-                {   
-                    // ....还没有进行真正的处理
-                    rdp->response.set_value(msg);   // 设置好future的值
+                if(closed.empty() == false)
+                {
+                    LOG(WARING, "连接断开，%llu 个未完成的请求失败！\n", (unsigned long long)closed.size());
                 }
-                // 如果设置的是回调处理
-                else if(rdp->rtype == RType::REQ_CALLBACK)
+                // 不持有锁时执行回调，回调中可能会再次发起请求
+                for(auto& rdp : closed)
                 {
-                    // 调用回调函数进行处理
-                    if(rdp->callback)
-                        rdp->callback(msg);
+                    fail(rdp, RCode::RCODE_DISCONNECTED);
                 }
-                else
+            }
+
+            // 针对响应的处理
+            // 第一个参数是连接，第二个参数输入型参数，是响应信息
+            void onResponse(const BaseConnection::ptr& conn, BaseMessage::ptr& msg)
+            {
+                uint64_t rid = msg->rid();
+                // 查找并删除请求描述在同一次加锁中完成
+                RequestDescribe::ptr rdp = takeDescribe(rid);
+                if(rdp == RequestDescribe::ptr())
                 {
-                    LOG(WARING, "请求类型未知\n");
+                    LOG(FATAL, "收到响应 - %llu，但是未找到对应的请求描述类!\n", (unsigned long long)rid);
+                    return;
                 }
-                // 处理完后删掉请求描述类
-                delDescribe(msg->rid());
+                complete(rdp, msg);
             }
 
             // 异步调用(非阻塞)
-            bool send(const BaseConnection::ptr &conn, const BaseMessage::ptr &req, AsyncResponse &async_rsp)
+            // timeout_ms毫秒内没有收到响应，则以RCODE_TIMEOUT的响应完成该请求
+            bool send(const BaseConnection::ptr &conn, const BaseMessage::ptr &req, AsyncResponse &async_rsp, 
+                      int timeout_ms = defaultTimeout)
             {
+                if(conn.get() == nullptr || conn->connected() == false)
+                {
+                    LOG(WARING, "连接不存在或已断开，无法发送请求！\n");
+                    return false;
+                }
                 // 构造请求描述类，插入hash表中进行管理
-                RequestDescribe::ptr rdp = newDescribe(req, RType::REQ_ASYNC);
+                RequestDescribe::ptr rdp = newDescribe(conn, req, RType::REQ_ASYNC, timeout_ms);
                 if(rdp.get() == nullptr)
                 {
                     LOG(FATAL, "构造请求描述对象失败！\n");
                     return false;
                 }
-                // 发送请求
-                conn->send(req);
-
                 // 将async_rsp这个future类关联到rdp->response这个promise类，等到其他线程的promise调用set_value后
                 // async_rsp调用get()就可以获取结果了
+                // 需要在发送之前关联，否则响应可能先到达并完成请求
                 async_rsp = rdp->response.get_future();
+                // 发送请求
+                conn->send(req);
+                checkClosed(conn, req->rid());
                 return true;
             }
             
             // 同步调用(阻塞)
-            bool send(const BaseConnection::ptr &conn, const BaseMessage::ptr &req, BaseMessage::ptr &rsp)
+            bool send(const BaseConnection::ptr &conn, const BaseMessage::ptr &req, BaseMessage::ptr &rsp, 
+                      int timeout_ms = defaultTimeout)
             {
+                // 响应由连接所属的I/O线程处理，在这个线程中阻塞等待响应会导致死锁
+                if(conn.get() != nullptr && conn->inLoopThread())
+                {
+                    LOG(FATAL, "不能在连接的I/O线程中发起同步请求！\n");
+                    return false;
+                }
                 AsyncResponse rsp_future;
                 // 异步发送数据
-                bool ret = send(conn, req, rsp_future);
+                bool ret = send(conn, req, rsp_future, timeout_ms);
                 if(ret == false)
                 {
                     return false;
@@ -101,54 +148,150 @@ namespace util_ns
             }
 
             // 回调方法处理响应(非阻塞)，回调函数自动处理
-            bool send(const BaseConnection::ptr &conn, const BaseMessage::ptr &req, const RequestCallback &cb)
+            bool send(const BaseConnection::ptr &conn, const BaseMessage::ptr &req, const RequestCallback &cb, 
+                      int timeout_ms = defaultTimeout)
             {
-                RequestDescribe::ptr rdp = newDescribe(req, RType::REQ_CALLBACK, cb);
+                if(conn.get() == nullptr || conn->connected() == false)
+                {
+                    LOG(WARING, "连接不存在或已断开，无法发送请求！\n");
+                    return false;
+                }
+                RequestDescribe::ptr rdp = newDescribe(conn, req, RType::REQ_CALLBACK, timeout_ms, cb);
                 if(rdp.get() == nullptr)
                 {
                     LOG(FATAL, "构造请求描述对象失败！\n");
                     return false;
                 }
                 conn->send(req);
+                checkClosed(conn, req->rid());
                 return true;
             }
 
         private:
+            // 使用响应完成一个请求
+            void complete(const RequestDescribe::ptr& rdp, const BaseMessage::ptr& msg)
+            {
+                // 如果设置的是异步处理
+                if(rdp->rtype == RType::REQ_ASYNC)
+                {   
+                    rdp->response.set_value(msg);   // 设置好future的值
+                }
+                // 如果设置的是回调处理
+                else if(rdp->rtype == RType::REQ_CALLBACK)
+                {
+                    // 调用回调函数进行处理
+                    if(rdp->callback)
+                        rdp->callback(msg);
+                }
+                else
+                {
+                    LOG(WARING, "请求类型未知\n");
+                }
+            }
+
+            // 请求无法得到服务端的响应时，在本地构造一个对应类型的响应，携带错误码完成请求
+            void fail(const RequestDescribe::ptr& rdp, RCode rcode)
+            {
+                MType rsp_type;
+                switch(rdp->request->mtype())
+                {
+                    case MType::REQ_RPC : rsp_type = MType::RSP_RPC; break;
+                    case MType::REQ_TOPIC : rsp_type = MType::RSP_TOPIC; break;
+                    case MType::REQ_SERVICE : rsp_type = MType::RSP_SERVICE; break;
+                    default : rsp_type = rdp->request->mtype(); break;
+                }
+                auto rsp = std::dynamic_pointer_cast<JsonResponse>(MessageFactory::create(rsp_type));
+                if(rsp.get() == nullptr)
+                {
+                    LOG(FATAL, "构造错误响应失败！\n");
+                    return;
+                }
+                rsp->SetId(rdp->request->rid());
+                rsp->SetMytype(rsp_type);
+                rsp->setRCode(rcode);
+                BaseMessage::ptr msg = rsp;
+                complete(rdp, msg);
+            }
+
+            // 连接可能在检查之后、请求插入hash表之前断开，这时onClose已经执行过了，找不到这个请求
+            // 因此请求插入后再检查一次，连接已断开就由这里完成请求
+            void checkClosed(const BaseConnection::ptr& conn, uint64_t rid)
+            {
+                if(conn->connected())
+                    return;
+                RequestDescribe::ptr rdp = takeDescribe(rid);
+                if(rdp.get() == nullptr)
+                    return;
+                fail(rdp, RCode::RCODE_DISCONNECTED);
+            }
+
+            // 时间轮中的请求到期，如果请求仍未完成，则以超时完成该请求
+            // 请求完成时会从时间轮中取消，但到期和完成可能同时发生，这里找不到请求描述时直接忽略即可
+            void onTimeout(uint64_t rid)
+            {
+                RequestDescribe::ptr rdp = takeDescribe(rid);
+                if(rdp.get() == nullptr)
+                    return;
+                LOG(WARING, "请求 - %llu 超时！\n", (unsigned long long)rid);
+                fail(rdp, RCode::RCODE_TIMEOUT);
+            }
+
+            Shard& shardOf(uint64_t rid)
+            {
+                // id的低位是递增序号，直接取模即可均匀分布到各个分片
+                return _shards[rid & (shardCount - 1)];
+            }
+
             // 增：创建一个新的描述请求类，设置好后插入hash表中
-            RequestDescribe::ptr newDescribe(const BaseMessage::ptr& req,  
+            RequestDescribe::ptr newDescribe(const BaseConnection::ptr& conn, 
+                                             const BaseMessage::ptr& req,  
                                              RType rtype,  
+                                             int timeout_ms,
                                              const RequestCallback& cb = RequestCallback())
             {
-                RequestDescribe::ptr rd = std::make_shared<RequestDescribe>();
+                Shard& shard = shardOf(req->rid());
+                // 描述对象连同引用计数一起从分片的内存池中分配，不再每次make_shared
+                RequestDescribe::ptr rd = std::allocate_shared<RequestDescribe>(PoolAllocator<RequestDescribe>(shard.pool));
                 rd->request = req;
+                rd->conn = conn;
                 rd->rtype = rtype;
                 // 如果是rtype规定是回调处理，那么顺便设置好rd->callback变量，否则不需要
                 if(rtype == RType::REQ_CALLBACK && cb)
                 {
                     rd->callback = cb;
                 }
-                std::unique_lock<std::mutex> lock(_mutex);
-                _request_desc.insert(std::make_pair(req->rid(), rd));
+                conn->addInflight(1);
+                std::unique_lock<std::mutex> lock(shard._mutex);
+                // 在分片锁中设置超时，句柄的读写都在分片锁中
+                if(timeout_ms > 0)
+                    rd->timer = _wheel.add(req->rid(), timeout_ms);
+                shard.requests.insert(std::make_pair(req->rid(), rd));
+                conn->addPending(req->rid());
                 return rd;
             }
 
-            // 查：获取一个请求描述类
-            RequestDescribe::ptr getDescribe(const std::string& rid)
+            // 查并删：取出一个请求描述类，同时从hash表中删除
+            RequestDescribe::ptr takeDescribe(uint64_t rid)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
-                auto it = _request_desc.find(rid);
-                if(it == _request_desc.end())
+                Shard& shard = shardOf(rid);
+                std::unique_lock<std::mutex> lock(shard._mutex);
+                auto it = shard.requests.find(rid);
+                if(it == shard.requests.end())
                 {
                     return RequestDescribe::ptr();
                 }
-                return it->second;
+                RequestDescribe::ptr rd = std::move(it->second);
+                shard.requests.erase(it);
+                rd->conn->addInflight(-1);
+                rd->conn->removePending(rid);
+                _wheel.cancel(rd->timer, rid);
+                return rd;
             }
 
             // 删
-            void delDescribe(const std::string& rid)
+            void delDescribe(uint64_t rid)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _request_desc.erase(rid);
+                takeDescribe(rid);
             }
         };
     };
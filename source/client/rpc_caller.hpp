@@ -22,13 +22,15 @@ namespace util_ns
 
             // 这里采用异步调用来获取结果
             // 第一个参数是连接，第二个参数是方法名，第三个参数是方法的参数，第四个方法是future异步保存响应结果
+            // 第五个参数是超时时间(ms)，超时后请求以RCODE_TIMEOUT结束，小于等于0表示不设置超时
             bool call(const BaseConnection::ptr& conn, const std::string& method, 
-                      const Json::Value& params, JsonAsyncResponse& result)
+                      const Json::Value& params, JsonAsyncResponse& result, 
+                      int timeout_ms = Requestor::defaultTimeout)
             {
                 // 需要向服务器发送异步回调请求，设置回调函数，回调函数中会传入一个promise对象，在回调函数中去让promise设置数据
                 // 1. 组织请求
                 auto req_msg = MessageFactory::create<RpcRequest>();
-                req_msg->SetId(UUID::uuid());
+                req_msg->SetId(IDGenerator::nextId());
                 req_msg->SetMytype(MType::REQ_RPC);
                 req_msg->setMethod(method);
                 req_msg->setParms(params);
@@ -38,7 +40,7 @@ namespace util_ns
                 Requestor::RequestCallback cb = std::bind(&RpcCaller::Callback, this, json_promise, std::placeholders::_1);
                 // 2. 发送请求
                 // 3. 等待响应
-                bool ret = _requestor->send(conn, req_msg, cb); /////////////////////////////////////
+                bool ret = _requestor->send(conn, req_msg, cb, timeout_ms);
                 if(ret == false)
                 {
                     LOG(FATAL, "异步Rpc请求失败!\n");
@@ -49,18 +51,19 @@ namespace util_ns
 
             // 采用同步调用来获取结果
             bool call(const BaseConnection::ptr& conn, const std::string& method, 
-                      const Json::Value& params, Json::Value& result)
+                      const Json::Value& params, Json::Value& result, 
+                      int timeout_ms = Requestor::defaultTimeout)
             {
                 // 1. 组织请求
                 auto req_msg = MessageFactory::create<RpcRequest>();
-                req_msg->SetId(UUID::uuid());
+                req_msg->SetId(IDGenerator::nextId());
                 req_msg->SetMytype(MType::REQ_RPC);
                 req_msg->setMethod(method);
                 req_msg->setParms(params);
 
                 BaseMessage::ptr rsp_msg;
                 // 2. 发送请求
-                bool ret = _requestor->send(conn, req_msg, rsp_msg);        
+                bool ret = _requestor->send(conn, req_msg, rsp_msg, timeout_ms);        
                 if(ret == false)
                 {
                     LOG(FATAL, "同步Rpc请求失败!\n");
@@ -85,11 +88,12 @@ namespace util_ns
 
             // 采用回调方法调用来获取结果
             bool call(const BaseConnection::ptr& conn, const std::string& method, 
-                      const Json::Value& params, const JsonResponseCallback &cb)
+                      const Json::Value& params, const JsonResponseCallback &cb, 
+                      int timeout_ms = Requestor::defaultTimeout)
             {
                 // 1. 组织请求
                 auto req_msg = MessageFactory::create<RpcRequest>();
-                req_msg->SetId(UUID::uuid());
+                req_msg->SetId(IDGenerator::nextId());
                 req_msg->SetMytype(MType::REQ_RPC);
                 req_msg->setMethod(method);
                 req_msg->setParms(params);
@@ -97,7 +101,7 @@ namespace util_ns
                 Requestor::RequestCallback req_cb = std::bind(&RpcCaller::CallbackA, this, cb, std::placeholders::_1);
                 // 2. 发送请求
                 // 3. 等待响应
-                bool ret = _requestor->send(conn, req_msg, req_cb);
+                bool ret = _requestor->send(conn, req_msg, req_cb, timeout_ms);
                 if(ret == false)
                 {
                     LOG(FATAL, "异步Rpc请求失败!\n");
@@ -117,7 +121,7 @@ namespace util_ns
                 }
                 if (rpc_rsp_msg->rcode() != RCode::RCODE_OK) 
                 {
-                    LOG(WARING, "rpc请求出错：%s", errReason(rpc_rsp_msg->rcode()));
+                    LOG(WARING, "rpc请求出错：%s\n", errReason(rpc_rsp_msg->rcode()).c_str());
                     return ;
                 }
                 // 直接处理响应的结果
@@ -134,7 +138,7 @@ namespace util_ns
                 }
                 if(rpc_rsp_msg->rcode() != RCode::RCODE_OK)
                 {
-                    LOG(WARING, "rpc异步请求出错：%s", errReason(rpc_rsp_msg->rcode()))
+                    LOG(WARING, "rpc异步请求出错：%s\n", errReason(rpc_rsp_msg->rcode()).c_str());
                 }
                 result->set_value(rpc_rsp_msg->result());
                 LOG(DEBUG, "promise成功设置好值了\n");
@@ -4,6 +4,8 @@
 #include "rpc_caller.hpp"
 #include "rpc_registry.hpp"
 #include "rpc_topic.hpp"
+#include <atomic>
+#include <vector>
 
 namespace util_ns
 {
@@ -32,6 +34,12 @@ namespace util_ns
                 auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
                 _client = ClientFactory::create(ip, port);
                 _client->setMessageCallback(message_cb);
+                // 由客户端的EventLoop驱动请求超时检测，连接断开时立即结束该连接上未完成的请求
+                _client->setTimerCallback(std::bind(&Requestor::onTick, _requestor.get()));
+                _client->setCloseCallback(std::bind(&Requestor::onClose, _requestor.get(), std::placeholders::_1));
+                // 与注册中心的连接断开后自动重连，重连成功后重新注册服务
+                _client->setConnectionCallback(std::bind(&Provider::onConnected, _provider.get(), std::placeholders::_1));
+                _client->enableReconnect();
                 _client->connect();
             }
 
@@ -70,6 +78,12 @@ namespace util_ns
                 auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
                 _client = ClientFactory::create(ip, port);
                 _client->setMessageCallback(message_cb);
+                // 由客户端的EventLoop驱动请求超时检测，连接断开时立即结束该连接上未完成的请求
+                _client->setTimerCallback(std::bind(&Requestor::onTick, _requestor.get()));
+                _client->setCloseCallback(std::bind(&Requestor::onClose, _requestor.get(), std::placeholders::_1));
+                // 与注册中心的连接断开后自动重连，重连成功后重新进行服务发现
+                _client->setConnectionCallback(std::bind(&Discoverer::onConnected, _discoverer.get(), std::placeholders::_1));
+                _client->enableReconnect();
                 _client->connect();
             }
 
@@ -78,6 +92,51 @@ namespace util_ns
             {
                 return _discoverer->serviceDiscovery(_client->connection(), method, host);
             }
+
+            // 设置服务提供者上线时的回调
+            void setOnlineCallback(const Discoverer::OnlineCallback& cb)
+            {
+                _discoverer->setOnlineCallback(cb);
+            }
+        };
+
+        // 与同一个服务提供者之间的多条连接
+        // 请求分散到多条TCP连接上，避免一个大响应阻塞同一条连接上的其他请求
+        class HostPool
+        {
+        private:
+            std::atomic<size_t> _next;              // 负载相同时轮转选择的起点
+            std::vector<BaseClient::ptr> _clients;  // 与服务提供者之间的连接，创建后不再修改
+        public:
+            using ptr = std::shared_ptr<HostPool>;
+
+            HostPool(const std::vector<BaseClient::ptr>& clients)
+                : _next(0), _clients(clients)
+            {}
+
+            // 选择等待响应的请求最少的可用连接，所有连接都不可用时返回空
+            BaseConnection::ptr connection()
+            {
+                BaseConnection::ptr best;
+                size_t start = _next.fetch_add(1, std::memory_order_relaxed);
+                for(size_t i = 0; i < _clients.size(); i++)
+                {
+                    BaseConnection::ptr conn = _clients[(start + i) % _clients.size()]->connection();
+                    if(conn.get() == nullptr || conn->connected() == false)
+                        continue;
+                    if(best.get() == nullptr || conn->inflight() < best->inflight())
+                        best = conn;
+                }
+                return best;
+            }
+
+            void setCodec(CodecType codec)
+            {
+                for(auto& client : _clients)
+                {
+                    client->setCodec(codec);
+                }
+            }
         };
 
         // 描述作为发起Rpc请求的客户端
@@ -89,6 +148,7 @@ namespace util_ns
         // 还有一种是短连接方式，也就是发起一次请求，就向服务器建立连接，请求完毕之后就删除连接，不过这种方式难以实现异步，
         // 因为可能还没有使用得到的异步结果future，连接就断开了，导致promise失效，future也无法使用了。连接断开是回调函数设置的，无法控制
         // 因此在这里使用长连接
+        // 与每个服务提供者之间会建立pool_size条连接（HostPool），默认使用进程内共享的客户端I/O线程
         class RpcClient
         {
         private:
@@ -102,109 +162,167 @@ namespace util_ns
                 }
             };
         private:
+            const double timerInterval = 0.01;      // 推进超时时间轮的间隔(s)
             std::mutex _mutex;                      // 线程安全
             bool _enableDiscovery;                  // 控制客户端类型
+            CodecType _codec;                       // rpc请求正文使用的编码方式
+            const int _pool_size;                   // 与每个服务提供者之间的连接数量
+            std::atomic<bool> _prewarm;             // 服务提供者上线时是否提前建立连接
             Requestor::ptr _requestor;              // 管理请求发送
             Dispatcher::ptr _dispatcher;            // 管理回调函数
             RpcCaller::ptr _caller;                 // 用于发起rpc请求
-            BaseClient::ptr _rpc_client;            // 未启用服务发现时与服务器之间的连接
+            ClientLoopPool::ptr _loops;             // rpc连接使用的I/O线程
+            LoopTimer::ptr _tick_timer;             // 推进请求的超时时间轮，与_requestor同生命周期，不依附于任何服务提供者的连接
+            HostPool::ptr _rpc_pool;                // 未启用服务发现时与服务器之间的连接
             DiscoveryClient::ptr _discovery_client; // 服务发现客户端
-            std::unordered_map<Address, BaseClient::ptr, AddressHash> _rpc_clients;   // 连接池
+            std::unordered_map<Address, HostPool::ptr, AddressHash> _rpc_clients;   // 连接池
         public:
             using ptr = std::shared_ptr<RpcClient>;
             // enableDiscovery--是否启用服务发现功能，也决定了传入的地址信息是注册中心的地址，还是服务提供者的地址
-            RpcClient(bool enableDiscovery, const std::string& ip, int port)
+            // pool_size--与每个服务提供者之间建立的连接数量
+            // io_threads--大于0时rpc连接使用独立的I/O线程，否则使用进程内共享的客户端I/O线程
+            RpcClient(bool enableDiscovery, const std::string& ip, int port, int pool_size = 1, int io_threads = 0)
                 :_enableDiscovery(enableDiscovery),
+                _codec(CodecType::CODEC_JSON),
+                _pool_size(pool_size > 0 ? pool_size : 1),
+                _prewarm(false),
                 _requestor(std::make_shared<Requestor>()),
                 _dispatcher(std::make_shared<Dispatcher>()),
-                _caller(std::make_shared<RpcCaller>(_requestor))
+                _caller(std::make_shared<RpcCaller>(_requestor)),
+                _loops(io_threads > 0 ? std::make_shared<ClientLoopPool>(io_threads) : ClientLoopPool::instance())
             {
+                // 服务提供者下线时会删除对应的连接池，如果由连接驱动时间轮，最后一个连接池删除后时间轮就停止了，
+                // 等待中的请求永远不会超时，因此由客户端自己的定时任务驱动
+                Requestor::ptr requestor = _requestor;
+                _tick_timer = std::make_shared<LoopTimer>(_loops, timerInterval, [requestor]() { requestor->onTick(); });
                 // 针对rpc请求后的响应进行的回调处理
                 auto rsp_cb = std::bind(&Requestor::onResponse, _requestor.get(), std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->registerHandler<BaseMessage>(MType::RSP_RPC, rsp_cb);
 
                 // 如果启用了服务发现，地址信息是注册中心的地址，是服务发现客户端需要连接的地址，则通过地址信息实例化discovery_client
-                // 如果没有启用服务发现，则地址信息是服务提供者的地址，则直接实例化好rpc_client
+                // 如果没有启用服务发现，则地址信息是服务提供者的地址，则直接实例化好rpc_pool
                 if(_enableDiscovery)
                 {
                     // 启用了
                     // 这里需要设置服务提供者连接断开时，对应的连接的回调，因为它们需要断开连接，删除对应的信息
                     auto offline_cb = std::bind(&RpcClient::delClient, this, std::placeholders::_1);
                     _discovery_client = std::make_shared<DiscoveryClient>(ip, port, offline_cb);
+                    auto online_cb = std::bind(&RpcClient::onHostOnline, this, std::placeholders::_1);
+                    _discovery_client->setOnlineCallback(online_cb);
                 }
                 else
                 {
                     // 没启用
-                    auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
-                    _rpc_client = ClientFactory::create(ip, port);
-                    _rpc_client->setMessageCallback(message_cb);
-                    _rpc_client->connect();
+                    _rpc_pool = newPool(Address(ip, port));
                 }
             }
 
+            // 设置rpc请求正文的编码方式，服务端会使用相同的编码方式进行响应
+            void setCodec(CodecType codec)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _codec = codec;
+                if(_rpc_pool)
+                {
+                    _rpc_pool->setCodec(codec);
+                }
+                for(auto& it : _rpc_clients)
+                {
+                    it.second->setCodec(codec);
+                }
+            }
+
+            // 启用后，注册中心通知有新的服务提供者上线时，提前与它建立连接，第一次请求不需要等待连接建立
+            void setPrewarm(bool prewarm)
+            {
+                _prewarm = prewarm;
+            }
+
             // 三种发起Rpc请求的方式
+            // timeout_ms为请求的超时时间(ms)，超时后请求以RCODE_TIMEOUT结束，小于等于0表示不设置超时
             // 同步
-            bool call(const std::string& method, const Json::Value& params, Json::Value& result)
+            bool call(const std::string& method, const Json::Value& params, Json::Value& result, 
+                      int timeout_ms = Requestor::defaultTimeout)
             {
                 // 获取服务提供者，1.服务发现 2. 固定服务提供者、
-                BaseClient::ptr client = getClient(method);
-                if(client.get() == nullptr)
+                BaseConnection::ptr conn = getConnection(method);
+                if(conn.get() == nullptr)
                 {
                     LOG(DEBUG, "获取服务提供者失败\n");
                     return false;
                 }
-                return _caller->call(client->connection(), method, params, result);
+                return _caller->call(conn, method, params, result, timeout_ms);
             }
 
             // 异步
-            bool call(const std::string& method, const Json::Value& params, RpcCaller::JsonAsyncResponse& result)
+            bool call(const std::string& method, const Json::Value& params, RpcCaller::JsonAsyncResponse& result, 
+                      int timeout_ms = Requestor::defaultTimeout)
             {
                 // 获取服务提供者，1.服务发现 2. 固定服务提供者、
-                BaseClient::ptr client = getClient(method);
-                if(client.get() == nullptr)
+                BaseConnection::ptr conn = getConnection(method);
+                if(conn.get() == nullptr)
                 {
                     LOG(DEBUG, "获取服务提供者失败\n");
                     return false;
                 }
-                return _caller->call(client->connection(), method, params, result);
+                return _caller->call(conn, method, params, result, timeout_ms);
             }
 
             // 回调
-            bool call(const std::string& method, const Json::Value& params, const RpcCaller::JsonResponseCallback& cb)
+            bool call(const std::string& method, const Json::Value& params, const RpcCaller::JsonResponseCallback& cb, 
+                      int timeout_ms = Requestor::defaultTimeout)
             {
                 // 获取服务提供者，1.服务发现 2. 固定服务提供者、
-                BaseClient::ptr client = getClient(method);
-                if(client.get() == nullptr)
+                BaseConnection::ptr conn = getConnection(method);
+                if(conn.get() == nullptr)
                 {
                     LOG(DEBUG, "获取服务提供者失败\n");
                     return false;
                 }
-                return _caller->call(client->connection(), method, params, cb);
+                return _caller->call(conn, method, params, cb, timeout_ms);
             }
         private:
+            // 服务提供者上线
+            void onHostOnline(const Address& host)
+            {
+                if(_prewarm == false || getClient(host))
+                    return;
+                LOG(INFO, "服务提供者 %s:%d 上线，提前建立连接\n", host.first.c_str(), host.second);
+                putClient(host, newPool(host));
+            }
+
             // 删：连接断开时删除连接
             void delClient(const Address& host)
             {
-                std::unique_lock<std::mutex> lock(_mutex);
-                _rpc_clients.erase(host);
+                HostPool::ptr pool;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    auto it = _rpc_clients.find(host);
+                    if(it == _rpc_clients.end())
+                        return;
+                    pool = std::move(it->second);
+                    _rpc_clients.erase(it);
+                }
+                // 连接池在锁外析构，析构时会等待连接在I/O线程中关闭并结束其上未完成的请求
             }
 
             // 有服务发现的情况下，通过host从连接池获取连接
-            BaseClient::ptr getClient(const Address& host)
+            HostPool::ptr getClient(const Address& host)
             {
                 std::unique_lock<std::mutex> lock(_mutex);
                 auto it = _rpc_clients.find(host);
                 if(it == _rpc_clients.end())
                 {
-                    return BaseClient::ptr();
+                    return HostPool::ptr();
                 }
                 return it->second;
             }
 
             // 查：通过method获取连接，服务发现可能有，也可能没有
-            BaseClient::ptr getClient(const std::string& method)
+            // 从对应服务提供者的多条连接中选择负载最小的一条
+            BaseConnection::ptr getConnection(const std::string& method)
             {
-                BaseClient::ptr client;
+                HostPool::ptr pool;
                 if(_enableDiscovery)
                 {
                     // 1.通过服务发现，获取服务提供者的地址信息
@@ -213,38 +331,55 @@ namespace util_ns
                     if(ret == false)
                     {
                         LOG(WARING, "当前 %s 服务，没有找到服务提供者！\n", method.c_str());
-                        return BaseClient::ptr();
+                        return BaseConnection::ptr();
                     }
                     // 查看对应的服务提供者是否已有实例化客户端存储在_rpc_clients中，有则直接使用，没有则创建
-                    client = getClient(host);
-                    if(client.get() == nullptr)
+                    pool = getClient(host);
+                    if(pool.get() == nullptr)
                     {
-                        client = newClient(host);
+                        pool = putClient(host, newPool(host));
                     }
                 }
                 else
                 {
-                    client = _rpc_client;
+                    pool = _rpc_pool;
                 }
-                return client;
+                return pool->connection();
             }
 
-            // 增：新建一个连接添加进连接池并返回
-            BaseClient::ptr newClient(const Address& host)
+            // 增：与服务提供者建立pool_size条连接
+            // 连接是异步建立的，不阻塞调用者，连接建立之前发送的请求会先排队
+            HostPool::ptr newPool(const Address& host)
             {
+                CodecType codec;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    codec = _codec;
+                }
                 auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
-                auto client = ClientFactory::create(host.first, host.second);
-                client->setMessageCallback(message_cb);
-                client->connect();
-                putClient(host, client);
-                return client;
+                std::vector<BaseClient::ptr> clients;
+                for(int i = 0; i < _pool_size; i++)
+                {
+                    // 连接按RR轮转分配到共享的I/O线程上
+                    auto client = ClientFactory::create(host.first, host.second, _loops);
+                    client->setMessageCallback(message_cb);
+                    client->setCloseCallback(std::bind(&Requestor::onClose, _requestor.get(), std::placeholders::_1));
+                    client->setCodec(codec);
+                    // 首次连接失败后也会在后台一直重连，连接池缓存的连接终会恢复可用，不需要重建连接池
+                    // 服务提供者下线时由服务发现的下线通知删除连接池
+                    client->enableReconnect();
+                    client->connect(ConnectDoneCallback());
+                    clients.push_back(client);
+                }
+                return std::make_shared<HostPool>(clients);
             }
 
-            // 增：添加进连接池
-            void putClient(const Address& host, BaseClient::ptr& client)
+            // 增：添加进连接池，其他线程已经添加过时使用已有的
+            HostPool::ptr putClient(const Address& host, const HostPool::ptr& pool)
             {
                 std::unique_lock<std::mutex> lock(_mutex);
-                _rpc_clients.insert(std::make_pair(host, client));
+                auto ret = _rpc_clients.insert(std::make_pair(host, pool));
+                return ret.first->second;
             }
         };
 
@@ -273,13 +408,20 @@ namespace util_ns
                 auto message_cb = std::bind(&Dispatcher::onMessage , _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
                 _rpc_client = ClientFactory::create(ip, port);
                 _rpc_client->setMessageCallback(message_cb);
+                _rpc_client->setTimerCallback(std::bind(&Requestor::onTick, _requestor.get()));
+                _rpc_client->setCloseCallback(std::bind(&Requestor::onClose, _requestor.get(), std::placeholders::_1));
+                // 与服务器的连接断开后自动重连，重连成功后重新订阅主题
+                _rpc_client->setConnectionCallback(std::bind(&TopicManager::onConnected, _topic_manager.get(), std::placeholders::_1));
+                _rpc_client->enableReconnect();
                 _rpc_client->connect();
             }
 
-            // 创建主题
-            bool create(const std::string& key)
+            // 创建主题，policy和queue_size为订阅者消费过慢时的处理策略和等待队列上限
+            // retention为服务端保留的最近消息数量，订阅时可以从中回放；durable为true时消息持久化到服务端的磁盘上
+            bool create(const std::string& key, TopicPolicy policy = TopicPolicy::POLICY_DROP_OLDEST, size_t queue_size = 0,
+                        size_t retention = 0, bool durable = false)
             {
-                return _topic_manager->create(_rpc_client->connection(), key);
+                return _topic_manager->create(_rpc_client->connection(), key, policy, queue_size, retention, durable);
             }
 
             // 删除主题
@@ -288,12 +430,30 @@ namespace util_ns
                 return _topic_manager->remove(_rpc_client->connection(), key);
             }
 
-            // 订阅主题
+            // 订阅主题，key可以是带通配符的模式：'*'匹配一级，'#'匹配剩余的多级
             bool subscribe(const std::string& key, const TopicManager::SubCallback& cb)
             {
                 return _topic_manager->subscribe(_rpc_client->connection(), key, cb);
             }
 
+            // 批量订阅主题，一次往返完成
+            bool subscribe(const std::vector<std::pair<std::string, TopicManager::SubCallback>>& subs)
+            {
+                return _topic_manager->subscribe(_rpc_client->connection(), subs);
+            }
+
+            // 订阅主题，先回放偏移量不小于offset的保留消息
+            bool subscribeFrom(const std::string& key, const TopicManager::SubCallback& cb, uint64_t offset)
+            {
+                return _topic_manager->subscribeFrom(_rpc_client->connection(), key, cb, offset);
+            }
+
+            // 订阅主题，先回放最近count条保留消息
+            bool subscribeLast(const std::string& key, const TopicManager::SubCallback& cb, size_t count)
+            {
+                return _topic_manager->subscribeLast(_rpc_client->connection(), key, cb, count);
+            }
+
             // 取消订阅主题
             bool cancel(const std::string& key)
             {
@@ -306,6 +466,57 @@ namespace util_ns
                 return _topic_manager->publish(_rpc_client->connection(), key, msg);
             }
 
+            // 消息推送，offset输出服务端分配给该消息的偏移量
+            bool publish(const std::string& key, const std::string& msg, uint64_t& offset)
+            {
+                return _topic_manager->publish(_rpc_client->connection(), key, msg, offset);
+            }
+
+            // 不需要确认的消息推送(QoS 0)，发送后立即返回，服务端不响应
+            bool publishNoAck(const std::string& key, const std::string& msg)
+            {
+                return _topic_manager->publishNoAck(_rpc_client->connection(), key, msg);
+            }
+
+            bool publishNoAck(const std::vector<TopicManager::TopicMessage>& batch)
+            {
+                return _topic_manager->publishNoAck(_rpc_client->connection(), batch);
+            }
+
+            // 异步消息推送，收到确认后调用cb
+            bool publish(const std::string& key, const std::string& msg, const TopicManager::PublishCallback& cb)
+            {
+                return _topic_manager->publish(_rpc_client->connection(), key, msg, cb);
+            }
+
+            // 批量消息推送，消息可以属于不同的主题，整批只有一次往返
+            bool publish(const std::vector<TopicManager::TopicMessage>& batch)
+            {
+                return _topic_manager->publish(_rpc_client->connection(), batch);
+            }
+
+            bool publish(const std::vector<TopicManager::TopicMessage>& batch, std::vector<uint64_t>& offsets)
+            {
+                return _topic_manager->publish(_rpc_client->connection(), batch, offsets);
+            }
+
+            // 异步批量消息推送，通过回调或future获取结果
+            bool publish(const std::vector<TopicManager::TopicMessage>& batch, const TopicManager::PublishCallback& cb)
+            {
+                return _topic_manager->publish(_rpc_client->connection(), batch, cb);
+            }
+
+            bool publish(const std::vector<TopicManager::TopicMessage>& batch, TopicManager::PublishAsyncResponse& result)
+            {
+                return _topic_manager->publish(_rpc_client->connection(), batch, result);
+            }
+
+            // 设置主题请求正文的编码方式，服务端的响应和推送会使用相同的编码方式
+            void setCodec(CodecType codec)
+            {
+                _rpc_client->setCodec(codec);
+            }
+
             // 关闭连接
             void shutdown()
             {
@@ -12,6 +12,8 @@ namespace util_ns
         class Provider
         {
         private:
+            std::mutex _mutex;
+            std::vector<std::pair<std::string, Address>> _methods;  // 已经注册成功的服务，与注册中心重连后重新注册
             Requestor::ptr _requestor;  // 用于发送服务注册请求
         public:
             using ptr = std::shared_ptr<Provider>;
@@ -23,12 +25,7 @@ namespace util_ns
             bool regitryMethod(const BaseConnection::ptr& conn, const std::string& method, const Address& host)
             {
                 // 1. 构建请求报文
-                auto msg_req = MessageFactory::create<ServiceRequest>();
-                msg_req->SetMytype(MType::REQ_SERVICE);
-                msg_req->SetId(UUID::uuid());
-                msg_req->setMethod(method);
-                msg_req->setHost(host);
-                msg_req->setOptype(ServiceOptype::SERVICE_REGISTRY);
+                auto msg_req = newRequest(method, host);
                 // 2. 发送请求，获取响应, 判断注册是否成功
                 BaseMessage::ptr msg_rsp;
                 bool ret = _requestor->send(conn, msg_req, msg_rsp);
@@ -37,6 +34,49 @@ namespace util_ns
                     LOG(WARING, "服务注册失败\n");
                     return false;
                 }
+                if(checkResponse(msg_rsp) == false)
+                {
+                    return false;
+                }
+                LOG(INFO, "服务注册成功\n");
+                std::unique_lock<std::mutex> lock(_mutex);
+                _methods.push_back(std::make_pair(method, host));
+                return true;
+            }
+
+            // 与注册中心的连接建立（包括断开后重连）时调用，重新注册已经注册过的服务
+            // 在连接的I/O线程中执行，因此使用回调方式发送请求，不能阻塞等待响应
+            void onConnected(const BaseConnection::ptr& conn)
+            {
+                std::vector<std::pair<std::string, Address>> methods;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    methods = _methods;
+                }
+                for(auto& it : methods)
+                {
+                    LOG(INFO, "重新注册服务 %s\n", it.first.c_str());
+                    auto msg_req = newRequest(it.first, it.second);
+                    _requestor->send(conn, msg_req, [this](const BaseMessage::ptr& msg_rsp)
+                    {
+                        checkResponse(msg_rsp);
+                    });
+                }
+            }
+        private:
+            ServiceRequest::ptr newRequest(const std::string& method, const Address& host)
+            {
+                auto msg_req = MessageFactory::create<ServiceRequest>();
+                msg_req->SetMytype(MType::REQ_SERVICE);
+                msg_req->SetId(IDGenerator::nextId());
+                msg_req->setMethod(method);
+                msg_req->setHost(host);
+                msg_req->setOptype(ServiceOptype::SERVICE_REGISTRY);
+                return msg_req;
+            }
+
+            bool checkResponse(const BaseMessage::ptr& msg_rsp)
+            {
                 auto service_rsp = std::dynamic_pointer_cast<ServiceResponse>(msg_rsp);
                 if(service_rsp.get() == nullptr)
                 {
@@ -48,7 +88,6 @@ namespace util_ns
                     LOG(WARING, "服务注册失败，原因：%s\n", errReason(service_rsp->rcode()).c_str());
                     return false;
                 }
-                LOG(INFO, "服务注册成功\n");
                 return true;
             }
         };
@@ -107,6 +146,13 @@ namespace util_ns
                 std::unique_lock<std::mutex> lock(_mutex);
                 return _hosts.empty();
             }
+
+            // 获取所有主机地址的拷贝
+            std::vector<Address> hosts()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                return _hosts;
+            }
         };
 
         // 描述作为服务发现者的客户端
@@ -115,9 +161,11 @@ namespace util_ns
         public:
             using ptr = std::shared_ptr<Discoverer>;
             using OfflineCallback = std::function<void(const Address&)>;   // 。。。。。。。。。。
+            using OnlineCallback = std::function<void(const Address&)>;    // 服务提供者上线时的回调
         private:
             std::mutex _mutex;
             Discoverer::OfflineCallback _offline_callback;
+            Discoverer::OnlineCallback _online_callback;
             std::unordered_map<std::string, MethodHost::ptr> _method_hosts; // 服务方法和对应的服务提供主机地址的映射
             Requestor::ptr _requestor;      // 用于服务发现请求发送
         public:          
@@ -125,6 +173,12 @@ namespace util_ns
                 : _requestor(requesotr), _offline_callback(cb)
             {}
 
+            // 设置服务提供者上线时的回调，需要在收到服务上线通知之前设置
+            void setOnlineCallback(const OnlineCallback &cb)
+            {
+                _online_callback = cb;
+            }
+
             // 服务发现调用
             // 第一个参数是和注册中心的连接，第二个参数是要发现的服务的名称，第三个参数是输出型参数，返回主机地址
             bool serviceDiscovery(const BaseConnection::ptr& conn, const std::string& method, Address& host)
@@ -133,7 +187,7 @@ namespace util_ns
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     auto it = _method_hosts.find(method);
-                    if(it != _method_hosts.end())
+                    if(it != _method_hosts.end() && it->second->empty() == false)
                     {
                         // 存在
                         host = it->second->chooseHost();
@@ -144,7 +198,7 @@ namespace util_ns
                 // 1. 构建请求
                 auto msg_req = MessageFactory::create<ServiceRequest>();
                 msg_req->SetMytype(MType::REQ_SERVICE);
-                msg_req->SetId(UUID::uuid());
+                msg_req->SetId(IDGenerator::nextId());
                 msg_req->setMethod(method);
                 msg_req->setOptype(ServiceOptype::SERVICE_DISCOVERY);
                 // 2. 发送请求，等待响应
@@ -182,6 +236,32 @@ namespace util_ns
                 return true;
             }
 
+            // 与注册中心的连接建立（包括断开后重连）时调用
+            // 注册中心在重启或连接断开后不再记得本客户端关心哪些服务，因此对已经发现过的服务重新进行服务发现，
+            // 这样既能继续收到服务上下线通知，也能更新断开期间变化的服务提供者
+            // 在连接的I/O线程中执行，因此使用回调方式发送请求，不能阻塞等待响应
+            void onConnected(const BaseConnection::ptr& conn)
+            {
+                std::vector<std::string> methods;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    for(auto& it : _method_hosts)
+                    {
+                        methods.push_back(it.first);
+                    }
+                }
+                for(auto& method : methods)
+                {
+                    LOG(INFO, "重新发现服务 %s\n", method.c_str());
+                    auto msg_req = MessageFactory::create<ServiceRequest>();
+                    msg_req->SetMytype(MType::REQ_SERVICE);
+                    msg_req->SetId(IDGenerator::nextId());
+                    msg_req->setMethod(method);
+                    msg_req->setOptype(ServiceOptype::SERVICE_DISCOVERY);
+                    _requestor->send(conn, msg_req, std::bind(&Discoverer::onRediscovery, this, method, std::placeholders::_1));
+                }
+            }
+
             // 这个接口是提供给Dispatcher模块进行服务上线下线请求处理的回调函数
             void onServiceRequest(const BaseConnection::ptr& conn, const ServiceRequest::ptr& msg)
             {
@@ -189,33 +269,88 @@ namespace util_ns
                 auto optype = msg->optype();
                 std::string method = msg->method();
                 
-                std::unique_lock<std::mutex> lock(_mutex);
                 if(optype == ServiceOptype::SERVICE_ONLINE)
                 {
-                    // 服务上线，找到对应服务的methodHost，向其中添加一个主机地址
-                    auto it = _method_hosts.find(method);
-                    if(it == _method_hosts.end())
-                    {
-                        // 没有对应的映射关系，需要新建MethodHost
-                        auto method_host = std::make_shared<MethodHost>();
-                        method_host->appendHost(msg->host());
-                        _method_hosts[method] = method_host;
-                    }
-                    else
                     {
-                        it->second->appendHost(msg->host());
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        // 服务上线，找到对应服务的methodHost，向其中添加一个主机地址
+                        auto it = _method_hosts.find(method);
+                        if(it == _method_hosts.end())
+                        {
+                            // 没有对应的映射关系，需要新建MethodHost
+                            auto method_host = std::make_shared<MethodHost>();
+                            method_host->appendHost(msg->host());
+                            _method_hosts[method] = method_host;
+                        }
+                        else
+                        {
+                            it->second->appendHost(msg->host());
+                        }
                     }
+                    // 不持有锁时通知上层，上层可以提前建立与新主机的连接
+                    if(_online_callback)
+                        _online_callback(msg->host());
                 }
                 else if(optype == ServiceOptype::SERVICE_OFFLINE)
                 {
-                    // 服务下线，不是主机下线，找到MethodHost并删掉其中一个主机地址即可
-                    auto it = _method_hosts.find(method);
-                    if(it == _method_hosts.end())
                     {
-                        return;
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        // 服务下线，不是主机下线，找到MethodHost并删掉其中一个主机地址即可
+                        auto it = _method_hosts.find(method);
+                        if(it == _method_hosts.end())
+                        {
+                            return;
+                        }
+                        it->second->removeHost(msg->host());
                     }
-                    it->second->removeHost(msg->host());
-                    _offline_callback(msg->host());
+                    // 不持有锁时通知上层，上层删除连接池时会等待连接关闭
+                    if(_offline_callback)
+                        _offline_callback(msg->host());
+                }
+            }
+
+        private:
+            // 重新发现服务的响应，使用最新的服务提供者替换原有的
+            // 断开期间下线的服务提供者不会再收到下线通知，因此与原有的列表比较，对消失的主机调用下线回调，新出现的主机调用上线回调
+            void onRediscovery(const std::string& method, const BaseMessage::ptr& msg_rsp)
+            {
+                auto service_rsp = std::dynamic_pointer_cast<ServiceResponse>(msg_rsp);
+                if(service_rsp.get() == nullptr ||
+                    (service_rsp->rcode() != RCode::RCODE_OK && service_rsp->rcode() != RCode::RCODE_NOT_FOUND_SERVICE))
+                {
+                    LOG(WARING, "%s 服务重新发现失败！\n", method.c_str());
+                    return;
+                }
+                // 没有找到服务说明所有提供者都在断开期间下线了，按空列表处理
+                std::vector<Address> hosts;
+                if(service_rsp->rcode() == RCode::RCODE_OK)
+                    hosts = service_rsp->hosts();
+                std::vector<Address> old_hosts;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    auto it = _method_hosts.find(method);
+                    if(it != _method_hosts.end())
+                        old_hosts = it->second->hosts();
+                    if(hosts.empty())
+                        _method_hosts.erase(method);
+                    else
+                        _method_hosts[method] = std::make_shared<MethodHost>(hosts);
+                }
+                // 不持有锁时通知上层
+                for(auto& host : old_hosts)
+                {
+                    if(std::find(hosts.begin(), hosts.end(), host) != hosts.end())
+                        continue;
+                    LOG(INFO, "服务提供者 %s:%d 在断开期间下线\n", host.first.c_str(), host.second);
+                    if(_offline_callback)
+                        _offline_callback(host);
+                }
+                for(auto& host : hosts)
+                {
+                    if(std::find(old_hosts.begin(), old_hosts.end(), host) != old_hosts.end())
+                        continue;
+                    if(_online_callback)
+                        _online_callback(host);
                 }
             }
         };
@@ -1,6 +1,7 @@
 #pragma once
 #include "requestor.hpp"
 #include <unordered_set>
+#include <vector>
 
 namespace util_ns
 {
@@ -12,9 +13,16 @@ namespace util_ns
         public:
             using ptr = std::shared_ptr<TopicManager>;
             using SubCallback = std::function<void(const std::string& key, const std::string& msg)>;    
+            using TopicMessage = std::pair<std::string, std::string>;  // 主题名称 与 消息内容
+            // 异步发布的结果：是否成功，以及每条消息的偏移量
+            using PublishCallback = std::function<void(bool ok, const std::vector<uint64_t>& offsets)>;
+            using PublishAsyncResponse = std::future<std::vector<uint64_t>>; // 失败时为空
         private:
             std::mutex _mutex;
             std::unordered_map<std::string, SubCallback> _topic_callbacks;   // 主题和处理对应推送的回调函数的映射
+            std::unordered_map<std::string, SubCallback> _pattern_callbacks; // 通配符模式和回调函数的映射
+            TopicTrie<std::string> _patterns;                                // 通配符模式的匹配树，收到推送时查找匹配的模式
+            std::unordered_map<std::string, uint64_t> _offsets;              // 主题下一条待接收消息的偏移量，重新订阅时从这里回放
             Requestor::ptr _requestor;  // 管理发送请求
         public:
             TopicManager(const Requestor::ptr& requestor)
@@ -22,10 +30,28 @@ namespace util_ns
             {}
 
             // 请求创建主题
-            bool create(const BaseConnection::ptr& conn, const std::string& key)
+            // policy为订阅者消费过慢、等待队列满时的处理策略，queue_size为每个订阅者等待队列的上限，为0时由服务端决定
+            // retention为服务端保留的最近消息数量，用于订阅时回放，为0时不保留
+            // durable为true时服务端把消息持久化到磁盘，落盘后才响应发布，重启后仍然可以回放，此时忽略retention
+            bool create(const BaseConnection::ptr& conn, const std::string& key, 
+                        TopicPolicy policy = TopicPolicy::POLICY_DROP_OLDEST, size_t queue_size = 0, size_t retention = 0,
+                        bool durable = false)
             {
-                bool ret;
-                ret = commonRequest(conn, key, TopicOptype::TOPIC_CREATE);
+                auto msg_req = newRequest(key, TopicOptype::TOPIC_CREATE);
+                msg_req->setPolicy(policy);
+                if(queue_size > 0)
+                {
+                    msg_req->setQueueSize(queue_size);
+                }
+                if(retention > 0)
+                {
+                    msg_req->setRetention(retention);
+                }
+                if(durable)
+                {
+                    msg_req->setDurable(true);
+                }
+                bool ret = commonRequest(conn, msg_req);
                 if(ret)
                 {
                     LOG(DEBUG, "主题创建成功\n");
@@ -43,18 +69,48 @@ namespace util_ns
                 return commonRequest(conn, key, TopicOptype::TOPIC_REMOVE);
             }
 
-            // 请求订阅主题
+            // 请求订阅主题，只接收订阅之后发布的消息
+            // key可以是带通配符的模式，例如 orders.* 或 orders.#，匹配的主题不需要事先存在，推送时回调收到的是实际的主题名称
             bool subscribe(const BaseConnection::ptr& conn, const std::string &key, const SubCallback &cb)
             {
-                addSubscribe(key, cb);
-                bool ret = commonRequest(conn, key, TopicOptype::TOPIC_SUBSCRIBE);
+                return subscribe(conn, key, cb, newRequest(key, TopicOptype::TOPIC_SUBSCRIBE));
+            }
+
+            // 请求订阅主题，先回放服务端保留的偏移量不小于offset的消息
+            bool subscribeFrom(const BaseConnection::ptr& conn, const std::string &key, const SubCallback &cb, uint64_t offset)
+            {
+                auto msg_req = newRequest(key, TopicOptype::TOPIC_SUBSCRIBE);
+                msg_req->setOffset(offset);
+                return subscribe(conn, key, cb, msg_req);
+            }
+
+            // 请求订阅主题，先回放服务端保留的最近count条消息
+            bool subscribeLast(const BaseConnection::ptr& conn, const std::string &key, const SubCallback &cb, size_t count)
+            {
+                auto msg_req = newRequest(key, TopicOptype::TOPIC_SUBSCRIBE);
+                msg_req->setLastCount(count);
+                return subscribe(conn, key, cb, msg_req);
+            }
+
+            // 批量订阅多个主题，一次请求完成，任何一个主题不存在时全部失败
+            bool subscribe(const BaseConnection::ptr& conn, const std::vector<std::pair<std::string, SubCallback>>& subs)
+            {
+                auto msg_req = newRequest("", TopicOptype::TOPIC_SUBSCRIBE_BATCH);
+                for(auto& sub : subs)
+                {
+                    addSubscribe(sub.first, sub.second);
+                    msg_req->appendSubscribe(sub.first);
+                }
+                bool ret = commonRequest(conn, msg_req);
                 if(ret == false)
                 {
-                    delSubscribe(key);
-                    LOG(DEBUG, "主题订阅失败\n");
+                    for(auto& sub : subs)
+                    {
+                        delSubscribe(sub.first);
+                    }
+                    LOG(DEBUG, "批量订阅主题失败\n");
                     return false;
                 }
-                LOG(DEBUG, "主题订阅成功\n");
                 return true;
             }
 
@@ -71,6 +127,109 @@ namespace util_ns
                 return commonRequest(conn, key, TopicOptype::TOPIC_PUBLISH, msg);
             }
 
+            // 根据主题推送对应的消息，offset输出服务端分配给该消息的偏移量
+            bool publish(const BaseConnection::ptr &conn, const std::string &key, const std::string &msg, uint64_t &offset)
+            {
+                TopicResponse::ptr msg_rsp;
+                bool ret = commonRequest(conn, newRequest(key, TopicOptype::TOPIC_PUBLISH, msg), msg_rsp);
+                if(ret == false)
+                    return false;
+                offset = msg_rsp->offset();
+                return true;
+            }
+
+            // 不需要确认的发布(QoS 0)：直接发送请求，不经过Requestor，也不等待响应
+            // 服务端不发送确认，发布失败（例如主题不存在）时客户端不会得到通知，适用于允许丢失的高频数据
+            bool publishNoAck(const BaseConnection::ptr &conn, const std::string &key, const std::string &msg)
+            {
+                auto msg_req = newRequest(key, TopicOptype::TOPIC_PUBLISH, msg);
+                return sendNoAck(conn, msg_req);
+            }
+
+            // 不需要确认的批量发布
+            bool publishNoAck(const BaseConnection::ptr &conn, const std::vector<TopicMessage> &batch)
+            {
+                return sendNoAck(conn, newBatch(batch));
+            }
+
+            // 异步发布一条消息，收到服务端的确认后调用cb，不阻塞等待
+            bool publish(const BaseConnection::ptr &conn, const std::string &key, const std::string &msg, 
+                         const PublishCallback &cb)
+            {
+                return publishAsync(conn, newRequest(key, TopicOptype::TOPIC_PUBLISH, msg), cb);
+            }
+
+            // 批量发布消息，可以属于不同的主题，一次请求一个确认，offsets输出每条消息的偏移量
+            bool publish(const BaseConnection::ptr &conn, const std::vector<TopicMessage> &batch, 
+                         std::vector<uint64_t> &offsets)
+            {
+                TopicResponse::ptr msg_rsp;
+                bool ret = commonRequest(conn, newBatch(batch), msg_rsp);
+                if(ret == false)
+                    return false;
+                offsets = msg_rsp->offsets();
+                return true;
+            }
+
+            bool publish(const BaseConnection::ptr &conn, const std::vector<TopicMessage> &batch)
+            {
+                return commonRequest(conn, newBatch(batch));
+            }
+
+            // 异步批量发布，整批消息确认后调用cb
+            bool publish(const BaseConnection::ptr &conn, const std::vector<TopicMessage> &batch, const PublishCallback &cb)
+            {
+                return publishAsync(conn, newBatch(batch), cb);
+            }
+
+            // 异步批量发布，通过future获取每条消息的偏移量，发布失败时为空
+            bool publish(const BaseConnection::ptr &conn, const std::vector<TopicMessage> &batch, PublishAsyncResponse &result)
+            {
+                auto promise = std::make_shared<std::promise<std::vector<uint64_t>>>();
+                result = promise->get_future();
+                return publishAsync(conn, newBatch(batch), [promise](bool ok, const std::vector<uint64_t>& offsets)
+                {
+                    promise->set_value(ok ? offsets : std::vector<uint64_t>());
+                });
+            }
+
+            // 与服务器的连接建立（包括断开后重连）时调用，重新订阅已经订阅过的主题
+            // 在连接的I/O线程中执行，因此使用回调方式发送请求，不能阻塞等待响应
+            void onConnected(const BaseConnection::ptr &conn)
+            {
+                std::vector<std::string> keys;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    for(auto& it : _topic_callbacks)
+                    {
+                        keys.push_back(it.first);
+                    }
+                    for(auto& it : _pattern_callbacks)
+                    {
+                        keys.push_back(it.first);
+                    }
+                }
+                for(auto& key : keys)
+                {
+                    LOG(INFO, "重新订阅主题 %s\n", key.c_str());
+                    auto msg_req = newRequest(key, TopicOptype::TOPIC_SUBSCRIBE);
+                    // 从断开前最后收到的消息之后开始回放，服务端没有保留消息时忽略该字段
+                    uint64_t offset = 0;
+                    if(nextOffset(key, offset))
+                    {
+                        msg_req->setOffset(offset);
+                    }
+                    _requestor->send(conn, msg_req, [key](const BaseMessage::ptr& msg_rsp)
+                    {
+                        auto topic_rsp_msg = std::dynamic_pointer_cast<TopicResponse>(msg_rsp);
+                        if(!topic_rsp_msg || topic_rsp_msg->rcode() != RCode::RCODE_OK)
+                        {
+                            LOG(WARING, "重新订阅主题 %s 失败！\n", key.c_str());
+                        }
+                    });
+                }
+            }
+
             // 如果收到推送，则相应的处理
             void onPublish(const BaseConnection::ptr &conn, const TopicRequest::ptr& msg)
             {
@@ -85,19 +244,68 @@ namespace util_ns
                 std::string topic_key = msg->topicKey();
                 std::string topic_msg = msg->topicMsg();
                 // 3. 通过主题名称，查找对应主题的回调处理函数，有在处理，无在报错
-                auto callback = getSubscribe(topic_key);
-                if(!callback)
+                if(msg->hasOffset())
+                {
+                    updateOffset(topic_key, msg->offset() + 1);
+                }
+                // 服务端对每个连接只推送一次，由客户端分发给主题本身以及所有匹配的模式的回调
+                std::vector<SubCallback> callbacks = getSubscribe(topic_key);
+                if(callbacks.empty())
                 {
                     LOG(WARING, "收到了 %s 主题消息，但是该消息无主题处理回调！\n", topic_key.c_str());
                     return;
                 }
-                return callback(topic_key, topic_msg);
+                for(auto& callback : callbacks)
+                {
+                    callback(topic_key, topic_msg);
+                }
             }
         private:
+            // 订阅主题，订阅失败时删除回调
+            bool subscribe(const BaseConnection::ptr& conn, const std::string &key, const SubCallback &cb, 
+                           const TopicRequest::ptr& msg_req)
+            {
+                addSubscribe(key, cb);
+                bool ret = commonRequest(conn, msg_req);
+                if(ret == false)
+                {
+                    delSubscribe(key);
+                    LOG(DEBUG, "主题订阅失败\n");
+                    return false;
+                }
+                LOG(DEBUG, "主题订阅成功\n");
+                return true;
+            }
+
+            // 记录主题下一条待接收消息的偏移量
+            void updateOffset(const std::string& key, uint64_t offset)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if(_topic_callbacks.count(key) == 0)
+                    return;
+                _offsets[key] = offset;
+            }
+
+            bool nextOffset(const std::string& key, uint64_t& offset)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _offsets.find(key);
+                if(it == _offsets.end())
+                    return false;
+                offset = it->second;
+                return true;
+            }
+
             // 添加订阅
             void addSubscribe(const std::string& key, const SubCallback& cb)
             {
                 std::unique_lock<std::mutex> lock(_mutex);
+                if(TopicName::isPattern(key))
+                {
+                    if(_pattern_callbacks.insert(std::make_pair(key, cb)).second)
+                        _patterns.insert(key, key);
+                    return;
+                }
                 _topic_callbacks.insert(std::make_pair(key, cb));
             }
 
@@ -106,34 +314,107 @@ namespace util_ns
             {
                 std::unique_lock<std::mutex> lock(_mutex);
                 _topic_callbacks.erase(key);
+                if(_pattern_callbacks.erase(key) > 0)
+                    _patterns.remove(key, key);
+                _offsets.erase(key);
             }
 
-            // 获取订阅
-            const SubCallback getSubscribe(const std::string& key)
+            // 获取主题对应的所有回调：主题本身的订阅以及匹配的通配符订阅
+            std::vector<SubCallback> getSubscribe(const std::string& key)
             {
+                std::vector<SubCallback> callbacks;
                 std::unique_lock<std::mutex> lock(_mutex);
                 auto it = _topic_callbacks.find(key);
-                if(it == _topic_callbacks.end())
+                if(it != _topic_callbacks.end())
                 {
-                    return SubCallback();
+                    callbacks.push_back(it->second);
                 }
-                return it->second;
+                // 通过匹配树只查找与主题名称匹配的模式，不逐个匹配所有的模式
+                std::vector<std::string> patterns;
+                _patterns.match(key, patterns);
+                for(auto& pattern : patterns)
+                {
+                    auto pit = _pattern_callbacks.find(pattern);
+                    if(pit != _pattern_callbacks.end())
+                        callbacks.push_back(pit->second);
+                }
+                return callbacks;
             }
 
-            // 发起对应的请求
-            // key是主题名称，type是对应的主题操作，msg是消息，根据操作类型判断是否需要msg
-            bool commonRequest(const BaseConnection::ptr& conn, const std::string& key, TopicOptype type, const std::string& msg = "")
+            // 构造主题请求
+            TopicRequest::ptr newRequest(const std::string& key, TopicOptype type, const std::string& msg = "")
             {
-                // 1. 构造请求对象
                 auto msg_req = MessageFactory::create<TopicRequest>();
                 msg_req->SetMytype(MType::REQ_TOPIC);
-                msg_req->SetId(UUID::uuid());
+                msg_req->SetId(IDGenerator::nextId());
                 msg_req->setOptype(type);
                 msg_req->setTopicKey(key);
                 if(type == TopicOptype::TOPIC_PUBLISH)
                 {
                     msg_req->setTopicMsg(msg);
                 }
+                return msg_req;
+            }
+
+            bool sendNoAck(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg_req)
+            {
+                if(conn.get() == nullptr || conn->connected() == false)
+                {
+                    LOG(WARING, "连接不存在或已断开，无法发布消息！\n");
+                    return false;
+                }
+                msg_req->setQos(0);
+                conn->send(msg_req);
+                return true;
+            }
+
+            // 构造批量发布请求
+            TopicRequest::ptr newBatch(const std::vector<TopicMessage>& batch)
+            {
+                auto msg_req = newRequest("", TopicOptype::TOPIC_PUBLISH_BATCH);
+                for(auto& item : batch)
+                {
+                    msg_req->appendPublish(item.first, item.second);
+                }
+                return msg_req;
+            }
+
+            // 异步发送发布请求，响应到达后在I/O线程中调用cb；单条发布的偏移量也以数组的形式返回
+            bool publishAsync(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg_req, const PublishCallback& cb)
+            {
+                return _requestor->send(conn, msg_req, [cb](const BaseMessage::ptr& msg_rsp)
+                {
+                    auto topic_rsp = std::dynamic_pointer_cast<TopicResponse>(msg_rsp);
+                    if(!topic_rsp || topic_rsp->rcode() != RCode::RCODE_OK)
+                    {
+                        LOG(WARING, "主题消息发布失败！\n");
+                        return cb(false, std::vector<uint64_t>());
+                    }
+                    if(topic_rsp->hasOffset())
+                        return cb(true, std::vector<uint64_t>(1, topic_rsp->offset()));
+                    cb(true, topic_rsp->offsets());
+                });
+            }
+
+            // 发起对应的请求
+            // key是主题名称，type是对应的主题操作，msg是消息，根据操作类型判断是否需要msg
+            bool commonRequest(const BaseConnection::ptr& conn, const std::string& key, TopicOptype type, const std::string& msg = "")
+            {
+                // 1. 构造请求对象
+                auto msg_req = newRequest(key, type, msg);
+                return commonRequest(conn, msg_req);
+            }
+
+            // 发送构造好的主题请求，等待响应
+            bool commonRequest(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg_req)
+            {
+                TopicResponse::ptr msg_rsp;
+                return commonRequest(conn, msg_req, msg_rsp);
+            }
+
+            // 发送构造好的主题请求，等待响应，topic_rsp输出成功的响应
+            bool commonRequest(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg_req, TopicResponse::ptr& topic_rsp)
+            {
                 // 2. 向服务端发送请求，等待响应
                 BaseMessage::ptr msg_rsp;
                 bool ret = _requestor->send(conn, msg_req, msg_rsp);
@@ -151,9 +432,10 @@ namespace util_ns
                 }
                 if(topic_rsp_msg->rcode() != RCode::RCODE_OK)
                 {
-                    LOG(WARING, "主题操作请求出错：%s\n", errReason(topic_rsp_msg->rcode()));
+                    LOG(WARING, "主题操作请求出错：%s\n", errReason(topic_rsp_msg->rcode()).c_str());
                     return false;
                 }
+                topic_rsp = topic_rsp_msg;
                 return true;
             }
         };
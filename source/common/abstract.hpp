@@ -1,18 +1,54 @@
 #pragma once
 
 #include <string>
+#include <cstring>
+#include <cstdint>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <unordered_set>
 #include <functional>
 #include "fields.hpp"
 
 namespace util_ns
 {
+    // 用于描述 缓冲区Buffer 的基类
+    class BaseBuffer
+    {
+    private:
+    public:
+        // 给 std::shared_ptr<BaseBuffer> 类型取别名为ptr
+        using ptr = std::shared_ptr<BaseBuffer>;
+        // 返回当前缓冲区中的数据大小
+        virtual size_t readableSize() = 0;
+        // 获取但不删除前4个字节的内容
+        virtual int32_t peekInt32() = 0;
+        // 删除前4个字节的内容，通常在peek后使用
+        virtual void retrieveInt32() = 0;
+        // 获取并删除前4个字节的内容
+        virtual int32_t readInt32() = 0;
+        // 从缓冲区中取出指定长度的字符串
+        virtual std::string retrieveAsString(size_t len) = 0;
+        // 获取可读数据的起始地址，不删除数据
+        virtual const char *peek() = 0;
+        // 删除指定长度的数据，通常在peek后使用
+        virtual void retrieve(size_t len) = 0;
+        // 在可读数据的末尾追加数据
+        virtual void append(const char *data, size_t len) = 0;
+        // 删除可读数据末尾指定长度的数据，用于撤销编码失败的报文
+        virtual void unwrite(size_t len) = 0;
+        // 以网络字节序改写可读区域中offset处的4个字节，用于报文写完后回填长度字段
+        virtual void pokeInt32(size_t offset, int32_t val) = 0;
+    };
+
     // 用于 描述数据包 的基类
     class BaseMessage
     {
     private:
-        util_ns::MType _mtype; // 消息类型
-        std::string _rid;      // 消息id
+        util_ns::MType _mtype;     // 消息类型
+        util_ns::CodecType _codec = util_ns::CodecType::CODEC_JSON; // 收到该消息时正文使用的编码方式
+        uint64_t _rid = 0;         // 消息id
     public:
         // 给 std::shared_ptr<BaseMessage> 类型取别名为ptr
         using ptr = std::shared_ptr<BaseMessage>;
@@ -20,7 +56,7 @@ namespace util_ns
         virtual ~BaseMessage() {}
 
         // 设置ID
-        virtual void SetId(const std::string &id)
+        virtual void SetId(uint64_t id)
         {
             _rid = id;
         }
@@ -31,7 +67,7 @@ namespace util_ns
             _mtype = mtype;
         }
 
-        virtual std::string rid()
+        virtual uint64_t rid()
         {
             return _rid;
         }
@@ -41,33 +77,48 @@ namespace util_ns
             return _mtype;
         }
 
+        // 设置/获取正文的编码方式
+        virtual void setCodec(util_ns::CodecType codec)
+        {
+            _codec = codec;
+        }
+
+        virtual util_ns::CodecType codec()
+        {
+            return _codec;
+        }
+
         // 序列化   纯虚函数
         virtual std::string serialize() = 0;
         // 反序列化
         virtual bool unserialize(const std::string &msg) = 0;
+        // 直接从一段连续内存中反序列化，避免先拷贝成字符串
+        virtual bool unserialize(const char *data, size_t len)
+        {
+            return unserialize(std::string(data, len));
+        }
+        // 按指定的编码方式序列化/反序列化，默认只支持json
+        virtual std::string serialize(util_ns::CodecType /*codec*/)
+        {
+            return serialize();
+        }
+        // 按指定的编码方式把正文直接追加到缓冲区，默认先序列化成字符串再拷贝
+        virtual bool serialize(util_ns::CodecType codec, BaseBuffer &out)
+        {
+            std::string body = serialize(codec);
+            out.append(body.data(), body.size());
+            return true;
+        }
+        virtual bool unserialize(const char *data, size_t len, util_ns::CodecType codec)
+        {
+            if (codec != util_ns::CodecType::CODEC_JSON)
+                return false;
+            return unserialize(data, len);
+        }
         // 反序列化后对信息进行校验
         virtual bool check() = 0;
     };
 
-    // 用于描述 缓冲区Buffer 的基类
-    class BaseBuffer
-    {
-    private:
-    public:
-        // 给 std::shared_ptr<BaseBuffer> 类型取别名为ptr
-        using ptr = std::shared_ptr<BaseBuffer>;
-        // 返回当前缓冲区中的数据大小
-        virtual size_t readableSize() = 0;
-        // 获取但不删除前4个字节的内容
-        virtual int32_t peekInt32() = 0;
-        // 删除前4个字节的内容，通常在peek后使用
-        virtual void retrieveInt32() = 0;
-        // 获取并删除前4个字节的内容
-        virtual int32_t readInt32() = 0;
-        // 从缓冲区中取出指定长度的字符串
-        virtual std::string retrieveAsString(size_t len) = 0;
-    };
-
     // 用于 根据缓冲区中的内容和自定义协议，从缓冲区中取出完整的数据包 的基类
     class BaseProtocol
     {
@@ -79,8 +130,15 @@ namespace util_ns
         virtual bool onMessage(const BaseBuffer::ptr &buf, BaseMessage::ptr &msg) = 0;
         // 发送消息时对其进行序列化
         virtual std::string serialize(const BaseMessage::ptr &msg) = 0;
+        // 按指定的正文编码方式进行序列化
+        virtual std::string serialize(const BaseMessage::ptr &msg, CodecType codec) = 0;
+        // 把完整的报文直接编码到缓冲区末尾，失败时缓冲区保持不变
+        virtual bool serialize(const BaseMessage::ptr &msg, CodecType codec, BaseBuffer &out) = 0;
     };
 
+    // 编码完成的完整报文，创建后不再修改，可以被多个连接共享发送
+    using Frame = std::shared_ptr<const std::string>;
+
     // 用于描述连接的基类
     class BaseConnection
     {
@@ -88,10 +146,66 @@ namespace util_ns
         using ptr = std::shared_ptr<BaseConnection>;
         // 发送消息
         virtual void send(const BaseMessage::ptr &msg) = 0;
+        // 发送编码好的报文，不再进行序列化
+        virtual void sendRaw(const Frame &frame) = 0;
         // 断开连接
         virtual void shutdown() = 0;
+        // 立即断开连接，不等待输出缓冲区中的数据发送完
+        virtual void forceClose()
+        {
+            shutdown();
+        }
         // 判断连接状态
         virtual bool connected() = 0;
+        // 设置/获取发送消息时正文使用的编码方式
+        virtual void setCodec(CodecType codec) = 0;
+        virtual CodecType codec() = 0;
+        // 输出缓冲区中积压的数据是否低于高水位，默认连接不做流量控制
+        virtual bool writable()
+        {
+            return true;
+        }
+        // 设置积压的数据发送完、连接重新变为可写时的回调
+        virtual void setWritableCallback(const std::function<void()> &/*cb*/)
+        {
+        }
+        // 立即发送批处理缓冲区中的报文，不等待本轮事件循环结束
+        virtual void flush() = 0;
+        // 判断当前线程是否是连接所属的I/O线程
+        virtual bool inLoopThread() = 0;
+        // 该连接上等待响应的请求数量，由Requestor维护，连接池根据它选择负载最小的连接
+        void addInflight(int n)
+        {
+            _inflight.fetch_add(n, std::memory_order_relaxed);
+        }
+        int inflight()
+        {
+            return _inflight.load(std::memory_order_relaxed);
+        }
+        // 该连接上等待响应的请求id，由Requestor维护，连接断开时只需要处理这些请求
+        void addPending(uint64_t rid)
+        {
+            std::unique_lock<std::mutex> lock(_pending_mutex);
+            _pending.insert(rid);
+        }
+        void removePending(uint64_t rid)
+        {
+            std::unique_lock<std::mutex> lock(_pending_mutex);
+            _pending.erase(rid);
+        }
+        // 取出并清空所有等待响应的请求id
+        std::vector<uint64_t> takePending()
+        {
+            std::unique_lock<std::mutex> lock(_pending_mutex);
+            std::vector<uint64_t> rids(_pending.begin(), _pending.end());
+            _pending.clear();
+            return rids;
+        }
+
+    private:
+        std::atomic<int> _inflight{0};
+        std::mutex _pending_mutex;
+        std::unordered_set<uint64_t> _pending;
     };
 
     // 给 void -(const BaseConnection::ptr&) 这种函数类型取别名为ConnectionCallback
@@ -99,6 +213,10 @@ namespace util_ns
     // ...
     using CloseCallback = std::function<void(const BaseConnection::ptr &)>;
     using MessageCallback = std::function<void(const BaseConnection::ptr &, BaseMessage::ptr &)>;
+    // 客户端的定时回调，用于驱动请求超时检测等周期性任务
+    using TimerCallback = std::function<void()>;
+    // 异步连接的结果回调，参数表示连接是否成功
+    using ConnectDoneCallback = std::function<void(bool)>;
 
     // 用于 描述服务器Server 的基类
     class BaseServer
@@ -107,8 +225,22 @@ namespace util_ns
         ConnectionCallback _cb_connection; // 连接建立的回调函数
         CloseCallback _cb_close;           // 连接断开的回调函数
         MessageCallback _cb_message;       // 收到消息的回调函数
+        size_t _batch_bytes = 64 * 1024;   // 发送批处理缓冲区达到该大小时立即发送
+        int _batch_delay_us = 0;           // 发送批处理的最长等待时间(us)，0表示在本轮事件循环结束时发送
+        size_t _high_water_mark = 4 * 1024 * 1024; // 连接输出缓冲区的高水位，超过后连接变为不可写
     public:
         using ptr = std::shared_ptr<BaseServer>;
+        // 设置连接输出缓冲区的高水位，需要在start()之前设置
+        virtual void setHighWaterMark(size_t bytes)
+        {
+            _high_water_mark = bytes;
+        }
+        // 设置连接的发送批处理参数，需要在start()之前设置
+        virtual void setSendBatch(size_t max_bytes, int delay_us)
+        {
+            _batch_bytes = max_bytes;
+            _batch_delay_us = delay_us;
+        }
         // 设置对应的回调函数
         virtual void setConnectionCallback(const ConnectionCallback &cb)
         {
@@ -134,8 +266,20 @@ namespace util_ns
         ConnectionCallback _cb_connection; // 连接建立的回调函数
         CloseCallback _cb_close;           // 连接断开的回调函数
         MessageCallback _cb_message;       // 收到消息的回调函数
+        TimerCallback _cb_timer;           // 定时回调函数
+        CodecType _codec = CodecType::CODEC_JSON; // 发送消息时正文使用的编码方式
+        int _connect_timeout_ms = 3000;    // 每次连接尝试的超时时间(ms)
+        int _connect_retries = 3;          // 连接失败后的重试次数，小于0表示一直重试
+        bool _reconnect = false;           // 连接断开后是否自动重连
+        size_t _batch_bytes = 64 * 1024;   // 发送批处理缓冲区达到该大小时立即发送
+        int _batch_delay_us = 0;           // 发送批处理的最长等待时间(us)，0表示在本轮事件循环结束时发送
     public:
         using ptr = std::shared_ptr<BaseClient>;
+        // 设置发送消息时正文使用的编码方式
+        virtual void setCodec(CodecType codec)
+        {
+            _codec = codec;
+        }
         // 设置对应的回调函数
         virtual void setConnectionCallback(const ConnectionCallback &cb)
         {
@@ -149,16 +293,42 @@ namespace util_ns
         {
             _cb_message = cb;
         }
+        // 需要在connect()之前设置，连接服务器后由客户端的EventLoop周期性调用
+        virtual void setTimerCallback(const TimerCallback &cb)
+        {
+            _cb_timer = cb;
+        }
+        // 设置连接超时时间和重试次数，需要在connect()之前设置
+        virtual void setConnectPolicy(int timeout_ms, int retries)
+        {
+            _connect_timeout_ms = timeout_ms > 0 ? timeout_ms : 1;
+            _connect_retries = retries;
+        }
+        // 设置连接的发送批处理参数，需要在connect()之前设置
+        virtual void setSendBatch(size_t max_bytes, int delay_us)
+        {
+            _batch_bytes = max_bytes;
+            _batch_delay_us = delay_us;
+        }
+        // 连接断开后按指数退避自动重连，直到重连成功或调用shutdown()，需要在connect()之前设置
+        // 首次连接的重试次数用完后，同样会通知等待者连接失败，然后在后台继续重连
+        // 重连成功后会再次调用连接建立的回调，上层在回调中恢复注册、订阅等状态
+        virtual void enableReconnect(bool on = true)
+        {
+            _reconnect = on;
+        }
         
-        // 连接服务器
+        // 连接服务器，阻塞直到连接成功或失败
         virtual void connect() = 0;
+        // 异步连接服务器，连接成功或失败后调用回调，连接建立之前发送的消息会先排队
+        virtual void connect(const ConnectDoneCallback &cb) = 0;
         // 关闭连接
         virtual void shutdown() = 0;
         // 发送消息
         virtual bool send(const BaseMessage::ptr&) = 0;
         // 获取当前连接
         virtual BaseConnection::ptr connection() = 0;
-        // 判断连接状态
+        // 判断连接是否可用：已经建立或正在建立
         virtual bool connected() = 0;
     };
 };
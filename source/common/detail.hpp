@@ -1,8 +1,12 @@
 /*
     实现项目中用到的一些琐碎功能代码
-    * 日志宏的定义
+    * 日志宏的定义（异步日志）
     * json的序列化和反序列化
-    * uuid的生成
+    * 二进制(MessagePack)的序列化和反序列化
+    * 请求id的生成
+    * CRC32校验
+    * 固定大小内存块池
+    * 主题名称的通配符匹配
 */
 
 /*日志宏*/
@@ -24,6 +28,16 @@
 #include <random>
 #include <atomic>
 #include <iomanip>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 
 #include <jsoncpp/json/json.h>
 
@@ -73,120 +87,277 @@ namespace util_ns
         }
     }
 
-    std::string GetCurrtime()
+    // 获取当前时间的字符串，每个线程缓存格式化结果，秒数变化时才重新格式化
+    const char *GetCurrtime()
     {
+        struct TimeCache
+        {
+            time_t sec = -1;
+            char buff[64];
+        };
+        static thread_local TimeCache cache;
         time_t now = time(nullptr);
-        struct tm *curr_time = localtime(&now);
-        char buff[128];
-        snprintf(buff, sizeof(buff), "%d-%02d-%02d %02d:%02d:%02d",
-                 curr_time->tm_year + 1900,
-                 curr_time->tm_mon + 1,
-                 curr_time->tm_mday,
-                 curr_time->tm_hour,
-                 curr_time->tm_min,
-                 curr_time->tm_sec);
-        return buff;
+        if (now != cache.sec)
+        {
+            struct tm curr_time;
+            localtime_r(&now, &curr_time); // localtime不是线程安全的
+            snprintf(cache.buff, sizeof(cache.buff), "%d-%02d-%02d %02d:%02d:%02d",
+                     curr_time.tm_year + 1900,
+                     curr_time.tm_mon + 1,
+                     curr_time.tm_mday,
+                     curr_time.tm_hour,
+                     curr_time.tm_min,
+                     curr_time.tm_sec);
+            cache.sec = now;
+        }
+        return cache.buff;
     }
 
-    class Logmessage
+    // 每个线程独享的日志缓冲区
+    // 单生产者(写日志的线程)单消费者(后台刷新线程)的环形缓冲区，写入时不加锁
+    class LogBuffer
     {
     public:
-        std::string _level;
-        pid_t _id;
-        std::string _filename;
-        int _filenumber;
-        std::string _cur_time;
-        std::string _message_info;
+        using ptr = std::shared_ptr<LogBuffer>;
+        static const size_t capacity = (1 << 16);
+
+        // 写入一条日志，剩余空间不足时返回false
+        bool push(const char *data, size_t len)
+        {
+            size_t head = _head.load(std::memory_order_relaxed);
+            size_t tail = _tail.load(std::memory_order_acquire);
+            if (capacity - (head - tail) < len)
+                return false;
+            size_t pos = head % capacity;
+            size_t first = std::min(len, capacity - pos);
+            memcpy(_data + pos, data, first);
+            memcpy(_data, data + first, len - first);
+            _head.store(head + len, std::memory_order_release);
+            return true;
+        }
+
+        // 取出所有日志追加到out中
+        void drain(std::string &out)
+        {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+            size_t head = _head.load(std::memory_order_acquire);
+            size_t len = head - tail;
+            if (len == 0)
+                return;
+            size_t pos = tail % capacity;
+            size_t first = std::min(len, capacity - pos);
+            out.append(_data + pos, first);
+            out.append(_data, len - first);
+            _tail.store(head, std::memory_order_release);
+        }
+
+        size_t size()
+        {
+            return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        std::atomic<size_t> _head{0}; // 写入位置
+        std::atomic<size_t> _tail{0}; // 读取位置
+        char _data[capacity];
     };
 
 #define SCREEN_TYPE 1
 #define FILE_TYPE 2
 
     const std::string glogfile = "./log.txt";
-    pthread_mutex_t glock = PTHREAD_MUTEX_INITIALIZER;
 
+    // 异步日志
+    // 1. 低于日志等级的日志在格式化之前就被过滤掉
+    // 2. 每个线程把格式化好的日志写入自己的缓冲区，不争抢全局锁
+    // 3. 后台线程定期收集所有线程的日志，一次write批量写出；文件只打开一次
     class Log
     {
+    private:
+        const int flushIntervalMs = 50;   // 后台线程刷新间隔
+        const int maxPushRetry = 1000;    // 缓冲区满时的最大重试次数，超过则丢弃该条日志
+        std::string _logfile;
+        std::atomic<int> _type;
+        std::atomic<int> _level;          // 日志等级阈值
+        std::atomic<int> _fd;             // 当前输出的文件描述符
+        pid_t _pid;
+        std::atomic<size_t> _dropped;     // 因缓冲区满被丢弃的日志数量
+
+        std::mutex _mutex; // 只在线程注册缓冲区以及后台线程等待时使用
+        std::mutex _write_mutex; // 串行化写出和切换输出，关闭旧的描述符时不能有线程还在向它写入
+        std::condition_variable _cond;
+        std::vector<LogBuffer::ptr> _buffers;
+        bool _running;
+        std::thread _flusher;
+
     public:
-        Log(const std::string filename = glogfile) : _logfile(filename), _type(SCREEN_TYPE)
+        Log(const std::string filename = glogfile)
+            : _logfile(filename), _type(SCREEN_TYPE), _level(DEBUG), _fd(STDOUT_FILENO),
+              _pid(getpid()), _dropped(0), _running(true)
         {
+            _flusher = std::thread(&Log::FlushThread, this);
         }
 
         void Enable(int type)
         {
+            int fd = STDOUT_FILENO;
+            if (type == FILE_TYPE)
+            {
+                fd = open(_logfile.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+                if (fd < 0)
+                    return;
+            }
+            Flush(); // 切换输出前先把已有的日志写到原来的位置
+            std::unique_lock<std::mutex> lock(_write_mutex);
+            int old = _fd.exchange(fd);
+            if (old != STDOUT_FILENO && old != fd)
+                close(old);
             _type = type;
         }
 
-        void FlushToScreen(const Logmessage &log)
+        // 设置日志等级阈值，低于该等级的日志直接丢弃
+        void SetLevel(int level)
         {
-            printf("[%s][%d][%s][%d][%s]:%s",
-                   log._level.c_str(),
-                   log._id,
-                   log._filename.c_str(),
-                   log._filenumber,
-                   log._cur_time.c_str(),
-                   log._message_info.c_str());
+            _level = level;
         }
 
-        void FlushToFile(const Logmessage &log)
+        bool Enabled(int level)
         {
-            std::ofstream out(_logfile, std::ios::app);
-            if (!out.is_open())
-                return;
-            char logtxt[2048];
-            snprintf(logtxt, sizeof(logtxt), "[%s][%d][%s][%d][%s] %s",
-                     log._level.c_str(),
-                     log._id,
-                     log._filename.c_str(),
-                     log._filenumber,
-                     log._cur_time.c_str(),
-                     log._message_info.c_str());
-            out.write(logtxt, strlen(logtxt));
-            out.close();
+            return level >= _level.load(std::memory_order_relaxed);
         }
 
-        void FlushLog(const Logmessage &lg)
+        size_t Dropped()
         {
-            // 加过滤逻辑 --- TODO
-
-            LockGuard lockguard(&glock);
-            switch (_type)
-            {
-            case SCREEN_TYPE:
-                FlushToScreen(lg);
-                break;
-            case FILE_TYPE:
-                FlushToFile(lg);
-                break;
-            }
+            return _dropped.load();
         }
 
-        void LogMessage(std::string filename, int filenumber, int level, const char *format, ...)
+        void LogMessage(const char *filename, int filenumber, int level, const char *format, ...)
         {
-            Logmessage lg;
-            lg._filename = filename;
-            lg._filenumber = filenumber;
-            lg._level = LevelToString(level);
-            lg._id = getpid();
-            lg._cur_time = GetCurrtime();
-
+            char logtxt[2048];
+            int n = snprintf(logtxt, sizeof(logtxt), "[%s][%d][%s][%d][%s]%s",
+                             LevelToString(level).c_str(),
+                             _pid,
+                             filename,
+                             filenumber,
+                             GetCurrtime(),
+                             _type == SCREEN_TYPE ? ":" : " ");
+            if (n < 0)
+                return;
             va_list ap;
             va_start(ap, format);
             char log_info[1024];
             vsnprintf(log_info, sizeof(log_info), format, ap);
             va_end(ap);
-            lg._message_info = log_info;
+            n += snprintf(logtxt + n, sizeof(logtxt) - n, "%s", log_info);
+            if (n >= (int)sizeof(logtxt))
+                n = sizeof(logtxt) - 1;
+
+            LogBuffer::ptr &buffer = LocalBuffer();
+            for (int i = 0; buffer->push(logtxt, n) == false; i++)
+            {
+                if (i >= maxPushRetry)
+                {
+                    _dropped++;
+                    return;
+                }
+                _cond.notify_one();
+                std::this_thread::yield();
+            }
+            if (buffer->size() > LogBuffer::capacity / 2)
+                _cond.notify_one();
+        }
 
-            FlushLog(lg);
+        // 立即把所有线程中的日志写出
+        void Flush()
+        {
+            std::string batch;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                Collect(batch);
+            }
+            Write(batch);
         }
 
         ~Log()
         {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _running = false;
+            }
+            _cond.notify_all();
+            if (_flusher.joinable())
+                _flusher.join();
+            Flush();
+            int fd = _fd.load();
+            if (fd != STDOUT_FILENO)
+                close(fd);
         }
 
     private:
-        std::string _logfile;
-        int _type;
+        // 获取当前线程的缓冲区，第一次使用时注册到后台线程
+        LogBuffer::ptr &LocalBuffer()
+        {
+            static thread_local LogBuffer::ptr buffer;
+            if (!buffer)
+            {
+                buffer = std::make_shared<LogBuffer>();
+                std::unique_lock<std::mutex> lock(_mutex);
+                _buffers.push_back(buffer);
+            }
+            return buffer;
+        }
+
+        // 收集所有缓冲区中的日志，调用者需持有_mutex
+        void Collect(std::string &batch)
+        {
+            for (size_t i = 0; i < _buffers.size();)
+            {
+                _buffers[i]->drain(batch);
+                // 线程已经退出并且日志已经取完，回收缓冲区
+                if (_buffers[i].use_count() == 1 && _buffers[i]->size() == 0)
+                {
+                    _buffers[i] = _buffers.back();
+                    _buffers.pop_back();
+                    continue;
+                }
+                i++;
+            }
+        }
+
+        void Write(const std::string &batch)
+        {
+            if (batch.empty())
+                return;
+            std::unique_lock<std::mutex> lock(_write_mutex);
+            int fd = _fd.load();
+            size_t written = 0;
+            while (written < batch.size())
+            {
+                ssize_t n = write(fd, batch.data() + written, batch.size() - written);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return;
+                written += n;
+            }
+        }
+
+        void FlushThread()
+        {
+            std::string batch;
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (_running)
+            {
+                _cond.wait_for(lock, std::chrono::milliseconds(flushIntervalMs));
+                Collect(batch);
+                if (batch.empty())
+                    continue;
+                lock.unlock();
+                Write(batch);
+                batch.clear();
+                lock.lock();
+            }
+        }
     };
 
     Log lg;
@@ -195,11 +366,13 @@ namespace util_ns
     // __LINE__ 是一个表示当前行号的宏
     // ## 是一个粘滞符，在这里可以保证即使可变参数包是空的也不会报错
     // __VA_ARGS__ 是一个用在宏函数里表示可变参数包的宏
+    // 先判断日志等级，被过滤掉的日志不会进行任何格式化
 
-#define LOG(level, Format, ...)                                          \
-    do                                                                   \
-    {                                                                    \
-        lg.LogMessage(__FILE__, __LINE__, level, Format, ##__VA_ARGS__); \
+#define LOG(level, Format, ...)                                              \
+    do                                                                       \
+    {                                                                        \
+        if (lg.Enabled(level))                                               \
+            lg.LogMessage(__FILE__, __LINE__, level, Format, ##__VA_ARGS__); \
     } while (0);
 
 #define EnableScreen()          \
@@ -212,6 +385,11 @@ namespace util_ns
     {                         \
         lg.Enable(FILE_TYPE); \
     } while (0)
+#define SetLogLevel(level)   \
+    do                       \
+    {                        \
+        lg.SetLevel(level);  \
+    } while (0)
 
 };
 
@@ -224,26 +402,41 @@ namespace util_ns
     public:
         static bool Serialize(const Json::Value &root, std::string &str)
         {
-            Json::StreamWriterBuilder swb;
-            std::unique_ptr<Json::StreamWriter> sw(swb.newStreamWriter());
+            Engine &engine = getEngine();
+            // 复用输出缓冲区，只清空内容
+            engine.ss.str(std::string());
+            engine.ss.clear();
+            int ret = engine.writer->write(root, &engine.ss);
+            if (ret != 0 || !engine.ss)
+            {
+                LOG(FATAL, "Serialize failed!\n");
+                return false;
+            }
+            str = engine.ss.str();
+            return true;
+        }
 
-            std::stringstream ss;
-            int ret = sw->write(root, &ss);
-            if (ret != 0)
+        // 直接写入输出流，输出流可以绑定到发送缓冲区上，避免生成中间字符串
+        static bool Serialize(const Json::Value &root, std::ostream &os)
+        {
+            int ret = getEngine().writer->write(root, &os);
+            if (ret != 0 || !os)
             {
                 LOG(FATAL, "Serialize failed!\n");
                 return false;
             }
-            str = ss.str();
             return true;
         }
 
         static bool UnSerialize(const std::string &str, Json::Value &root)
         {
-            Json::CharReaderBuilder crb;
-            std::unique_ptr<Json::CharReader> cr(crb.newCharReader());
+            return UnSerialize(str.c_str(), str.size(), root);
+        }
 
-            bool ret = cr->parse(str.c_str(), str.c_str() + str.size(), &root, nullptr);
+        // 直接解析一段连续内存，比如网络缓冲区中的可读区域
+        static bool UnSerialize(const char *data, size_t len, Json::Value &root)
+        {
+            bool ret = getEngine().reader->parse(data, data + len, &root, nullptr);
             if (!ret)
             {
                 LOG(FATAL, "UnSerialize failed!\n");
@@ -251,43 +444,758 @@ namespace util_ns
             }
             return true;
         }
+
+    private:
+        // 序列化引擎：StreamWriter/CharReader的构造开销很大，且配置从不改变
+        // 因此每个线程只构造一次，之后反复使用（StreamWriter/CharReader本身不是线程安全的）
+        struct Engine
+        {
+            std::unique_ptr<Json::StreamWriter> writer;
+            std::unique_ptr<Json::CharReader> reader;
+            std::ostringstream ss;
+
+            Engine()
+            {
+                Json::StreamWriterBuilder swb;
+                swb["indentation"] = ""; // 紧凑输出，默认的缩进格式会让报文体积变大
+                swb["emitUTF8"] = true;  // 中文等字符直接输出，不转义成\uXXXX
+                writer.reset(swb.newStreamWriter());
+
+                Json::CharReaderBuilder crb;
+                reader.reset(crb.newCharReader());
+            }
+        };
+
+        static Engine &getEngine()
+        {
+            static thread_local Engine engine;
+            return engine;
+        }
     };
 
 };
 
+// 紧凑的二进制正文编码，格式兼容MessagePack
+// 直接在Json::Value和二进制之间转换，上层消息的访问接口不需要任何改动
+namespace util_ns
+{
+    class MsgPack
+    {
+    private:
+        static const int maxDepth = 64; // 反序列化时允许的最大嵌套深度，防止恶意数据导致栈溢出
 
-// 生成UUID，用于标明唯一性
+    public:
+        static bool Serialize(const Json::Value &root, std::string &str)
+        {
+            str.clear();
+            return encode(root, str);
+        }
+
+        // 追加编码到任意输出目标的末尾，比如直接写入发送缓冲区
+        template <typename Out>
+        static bool SerializeTo(const Json::Value &root, Out &out)
+        {
+            return encode(root, out);
+        }
+
+        static bool UnSerialize(const std::string &str, Json::Value &root)
+        {
+            return UnSerialize(str.c_str(), str.size(), root);
+        }
+
+        static bool UnSerialize(const char *data, size_t len, Json::Value &root)
+        {
+            const uint8_t *pos = (const uint8_t *)data;
+            const uint8_t *end = pos + len;
+            if (decode(pos, end, root, 0) == false || pos != end)
+            {
+                LOG(FATAL, "MsgPack UnSerialize failed!\n");
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        // ---------------- 编码 ----------------
+        // 输出目标只需要提供push_back(char)和append(const char*, size_t)，std::string和网络缓冲区都可以
+        template <typename Out>
+        static void putBE(Out &out, uint64_t val, int bytes)
+        {
+            char tmp[8];
+            for (int i = 0; i < bytes; i++)
+            {
+                tmp[i] = (char)((val >> ((bytes - 1 - i) * 8)) & 0xFF);
+            }
+            out.append(tmp, bytes);
+        }
+
+        template <typename Out>
+        static void putHead(Out &out, uint8_t fix, uint8_t fix_max, uint8_t tag8, uint8_t tag16, uint8_t tag32, size_t len)
+        {
+            if (fix != 0 && len <= fix_max)
+            {
+                out.push_back((char)(fix | len));
+            }
+            else if (tag8 != 0 && len <= 0xFF)
+            {
+                out.push_back((char)tag8);
+                putBE(out, len, 1);
+            }
+            else if (len <= 0xFFFF)
+            {
+                out.push_back((char)tag16);
+                putBE(out, len, 2);
+            }
+            else
+            {
+                out.push_back((char)tag32);
+                putBE(out, len, 4);
+            }
+        }
+
+        template <typename Out>
+        static void putUInt(Out &out, uint64_t val)
+        {
+            if (val < 0x80)
+            {
+                out.push_back((char)val);
+            }
+            else if (val <= 0xFF)
+            {
+                out.push_back((char)0xcc);
+                putBE(out, val, 1);
+            }
+            else if (val <= 0xFFFF)
+            {
+                out.push_back((char)0xcd);
+                putBE(out, val, 2);
+            }
+            else if (val <= 0xFFFFFFFFull)
+            {
+                out.push_back((char)0xce);
+                putBE(out, val, 4);
+            }
+            else
+            {
+                out.push_back((char)0xcf);
+                putBE(out, val, 8);
+            }
+        }
+
+        template <typename Out>
+        static void putInt(Out &out, int64_t val)
+        {
+            if (val >= 0)
+            {
+                putUInt(out, (uint64_t)val);
+            }
+            else if (val >= -32)
+            {
+                out.push_back((char)(int8_t)val);
+            }
+            else if (val >= INT8_MIN)
+            {
+                out.push_back((char)0xd0);
+                putBE(out, (uint64_t)val, 1);
+            }
+            else if (val >= INT16_MIN)
+            {
+                out.push_back((char)0xd1);
+                putBE(out, (uint64_t)val, 2);
+            }
+            else if (val >= INT32_MIN)
+            {
+                out.push_back((char)0xd2);
+                putBE(out, (uint64_t)val, 4);
+            }
+            else
+            {
+                out.push_back((char)0xd3);
+                putBE(out, (uint64_t)val, 8);
+            }
+        }
+
+        template <typename Out>
+        static void putString(Out &out, const char *begin, const char *end)
+        {
+            size_t len = end - begin;
+            putHead(out, 0xa0, 31, 0xd9, 0xda, 0xdb, len);
+            out.append(begin, len);
+        }
+
+        template <typename Out>
+        static bool encode(const Json::Value &val, Out &out)
+        {
+            switch (val.type())
+            {
+            case Json::nullValue:
+                out.push_back((char)0xc0);
+                return true;
+            case Json::booleanValue:
+                out.push_back(val.asBool() ? (char)0xc3 : (char)0xc2);
+                return true;
+            case Json::intValue:
+                putInt(out, val.asInt64());
+                return true;
+            case Json::uintValue:
+                putUInt(out, val.asUInt64());
+                return true;
+            case Json::realValue:
+            {
+                double d = val.asDouble();
+                uint64_t bits = 0;
+                memcpy(&bits, &d, sizeof(bits));
+                out.push_back((char)0xcb);
+                putBE(out, bits, 8);
+                return true;
+            }
+            case Json::stringValue:
+            {
+                const char *begin = nullptr, *end = nullptr;
+                val.getString(&begin, &end);
+                putString(out, begin, end);
+                return true;
+            }
+            case Json::arrayValue:
+            {
+                putHead(out, 0x90, 15, 0, 0xdc, 0xdd, val.size());
+                for (Json::ArrayIndex i = 0; i < val.size(); i++)
+                {
+                    if (encode(val[i], out) == false)
+                        return false;
+                }
+                return true;
+            }
+            case Json::objectValue:
+            {
+                putHead(out, 0x80, 15, 0, 0xde, 0xdf, val.size());
+                for (auto it = val.begin(); it != val.end(); ++it)
+                {
+                    const char *end = nullptr;
+                    const char *begin = it.memberName(&end);
+                    putString(out, begin, end);
+                    if (encode(*it, out) == false)
+                        return false;
+                }
+                return true;
+            }
+            }
+            LOG(FATAL, "MsgPack Serialize failed!\n");
+            return false;
+        }
+
+        // ---------------- 解码 ----------------
+        static bool getBE(const uint8_t *&pos, const uint8_t *end, int bytes, uint64_t &val)
+        {
+            if (end - pos < bytes)
+                return false;
+            val = 0;
+            for (int i = 0; i < bytes; i++)
+            {
+                val = (val << 8) | pos[i];
+            }
+            pos += bytes;
+            return true;
+        }
+
+        static bool getString(const uint8_t *&pos, const uint8_t *end, size_t len, Json::Value &val)
+        {
+            if ((size_t)(end - pos) < len)
+                return false;
+            val = Json::Value((const char *)pos, (const char *)pos + len);
+            pos += len;
+            return true;
+        }
+
+        static Json::Value fromUInt(uint64_t v)
+        {
+            // 与json文本解析保持一致：能用有符号整形表示的就使用有符号整形
+            if (v <= (uint64_t)INT64_MAX)
+                return Json::Value((Json::Int64)v);
+            return Json::Value((Json::UInt64)v);
+        }
+
+        static bool decodeArray(const uint8_t *&pos, const uint8_t *end, size_t n, Json::Value &val, int depth)
+        {
+            val = Json::Value(Json::arrayValue);
+            for (size_t i = 0; i < n; i++)
+            {
+                Json::Value item;
+                if (decode(pos, end, item, depth + 1) == false)
+                    return false;
+                val.append(std::move(item));
+            }
+            return true;
+        }
+
+        static bool decodeMap(const uint8_t *&pos, const uint8_t *end, size_t n, Json::Value &val, int depth)
+        {
+            val = Json::Value(Json::objectValue);
+            for (size_t i = 0; i < n; i++)
+            {
+                Json::Value key;
+                if (decode(pos, end, key, depth + 1) == false || key.isString() == false)
+                    return false;
+                const char *kbegin = nullptr, *kend = nullptr;
+                key.getString(&kbegin, &kend);
+                Json::Value &item = val[std::string(kbegin, kend)];
+                if (decode(pos, end, item, depth + 1) == false)
+                    return false;
+            }
+            return true;
+        }
+
+        static bool decode(const uint8_t *&pos, const uint8_t *end, Json::Value &val, int depth)
+        {
+            if (pos >= end || depth > maxDepth)
+                return false;
+            uint8_t tag = *pos++;
+            uint64_t n = 0;
+            if (tag < 0x80) // positive fixint
+            {
+                val = Json::Value((Json::Int64)tag);
+                return true;
+            }
+            if (tag >= 0xe0) // negative fixint
+            {
+                val = Json::Value((Json::Int64)(int8_t)tag);
+                return true;
+            }
+            if ((tag & 0xf0) == 0x80)
+                return decodeMap(pos, end, tag & 0x0f, val, depth);
+            if ((tag & 0xf0) == 0x90)
+                return decodeArray(pos, end, tag & 0x0f, val, depth);
+            if ((tag & 0xe0) == 0xa0)
+                return getString(pos, end, tag & 0x1f, val);
+            switch (tag)
+            {
+            case 0xc0:
+                val = Json::Value();
+                return true;
+            case 0xc2:
+                val = Json::Value(false);
+                return true;
+            case 0xc3:
+                val = Json::Value(true);
+                return true;
+            case 0xcc:
+            case 0xcd:
+            case 0xce:
+            case 0xcf:
+                if (getBE(pos, end, 1 << (tag - 0xcc), n) == false)
+                    return false;
+                val = fromUInt(n);
+                return true;
+            case 0xd0:
+                if (getBE(pos, end, 1, n) == false)
+                    return false;
+                val = Json::Value((Json::Int64)(int8_t)n);
+                return true;
+            case 0xd1:
+                if (getBE(pos, end, 2, n) == false)
+                    return false;
+                val = Json::Value((Json::Int64)(int16_t)n);
+                return true;
+            case 0xd2:
+                if (getBE(pos, end, 4, n) == false)
+                    return false;
+                val = Json::Value((Json::Int64)(int32_t)n);
+                return true;
+            case 0xd3:
+                if (getBE(pos, end, 8, n) == false)
+                    return false;
+                val = Json::Value((Json::Int64)n);
+                return true;
+            case 0xca:
+            {
+                if (getBE(pos, end, 4, n) == false)
+                    return false;
+                uint32_t bits = (uint32_t)n;
+                float f = 0;
+                memcpy(&f, &bits, sizeof(f));
+                val = Json::Value((double)f);
+                return true;
+            }
+            case 0xcb:
+            {
+                if (getBE(pos, end, 8, n) == false)
+                    return false;
+                double d = 0;
+                memcpy(&d, &n, sizeof(d));
+                val = Json::Value(d);
+                return true;
+            }
+            case 0xc4: // bin按字符串处理
+            case 0xd9:
+                return getBE(pos, end, 1, n) && getString(pos, end, n, val);
+            case 0xc5:
+            case 0xda:
+                return getBE(pos, end, 2, n) && getString(pos, end, n, val);
+            case 0xc6:
+            case 0xdb:
+                return getBE(pos, end, 4, n) && getString(pos, end, n, val);
+            case 0xdc:
+                return getBE(pos, end, 2, n) && decodeArray(pos, end, n, val, depth);
+            case 0xdd:
+                return getBE(pos, end, 4, n) && decodeArray(pos, end, n, val, depth);
+            case 0xde:
+                return getBE(pos, end, 2, n) && decodeMap(pos, end, n, val, depth);
+            case 0xdf:
+                return getBE(pos, end, 4, n) && decodeMap(pos, end, n, val, depth);
+            }
+            return false;
+        }
+    };
+
+};
+
+// 生成请求ID，用于标明唯一性
 namespace util_ns
 {
-    class UUID
+    // 64位整形ID：高16位为进程前缀（进程启动时随机生成一次），低48位为原子递增序号
+    // 生成一个ID只需要一次原子加法，不再每次构造随机数引擎和格式化字符串
+    class IDGenerator
     {
+    private:
+        static const uint64_t seqMask = (1ull << 48) - 1;
+
     public:
-        static std::string uuid()
+        static uint64_t nextId()
+        {
+            static const uint64_t prefix = makePrefix();
+            static std::atomic<uint64_t> seq(1);
+            return prefix | (seq.fetch_add(1, std::memory_order_relaxed) & seqMask);
+        }
+
+    private:
+        static uint64_t makePrefix()
         {
-            std::stringstream ss;
-            //1. 构造一个机器随机数对象
             std::random_device rd;
-            //2. 以机器随机数为种子构造伪随机数对象
-            std::mt19937 generator(rd());
-            //3. 构造限定数据范围的对象
-            std::uniform_int_distribution<int> distribution(0, 255);
-            //4. 生成8个随机数，按照特定格式组织成为16进制数字字符的字符串
-            for (int i = 0; i < 8; i++) {
-                if (i == 4 || i == 6) ss << "-";
-                ss << std::setw(2) << std::setfill('0') <<std::hex << distribution(generator);
-            }
-            ss << "-";
-            //5. 定义一个8字节序号，逐字节组织成为16进制数字字符的字符串
-            static std::atomic<size_t> seq(1);
-            size_t cur = seq.fetch_add(1);
-            for(int i = 7; i >= 0; i--)
-            {
-                if(i == 5)
-                    ss << "-";
-                ss << std::setw(2) << std::setfill('0') << std::hex << ((cur >> (i*8)) & 0xFF); 
-            }
-            return ss.str();
+            uint64_t prefix = ((uint64_t)rd() ^ (uint64_t)getpid()) & 0xFFFF;
+            return prefix << 48;
+        }
+    };
+
+};
+
+// CRC32校验（IEEE 802.3多项式），用于检查持久化的记录是否完整
+namespace util_ns
+{
+    class Crc32
+    {
+    public:
+        static uint32_t compute(const char *data, size_t len)
+        {
+            static const std::vector<uint32_t> table = makeTable();
+            uint32_t crc = 0xFFFFFFFFu;
+            const unsigned char *p = (const unsigned char *)data;
+            for (size_t i = 0; i < len; i++)
+            {
+                crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+            }
+            return crc ^ 0xFFFFFFFFu;
+        }
+
+    private:
+        static std::vector<uint32_t> makeTable()
+        {
+            std::vector<uint32_t> table(256);
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                }
+                table[i] = c;
+            }
+            return table;
+        }
+    };
+
+};
+
+// 固定大小内存块池，用于频繁创建/销毁的小对象
+namespace util_ns
+{
+    // 第一次分配时确定块大小，之后相同大小的内存块从空闲链表中复用，其他大小直接使用operator new
+    class BlockPool
+    {
+    public:
+        using ptr = std::shared_ptr<BlockPool>;
+
+    private:
+        struct Node
+        {
+            Node *next;
+        };
+        std::mutex _mutex;
+        size_t _block_size;  // 内存块大小
+        size_t _max_free;    // 空闲链表的最大长度，超过的内存块直接释放
+        size_t _free_count;  // 当前空闲链表长度
+        Node *_free;         // 空闲链表
+
+    public:
+        BlockPool(size_t max_free = 1024)
+            : _block_size(0), _max_free(max_free), _free_count(0), _free(nullptr)
+        {}
+
+        ~BlockPool()
+        {
+            while (_free)
+            {
+                Node *node = _free;
+                _free = node->next;
+                ::operator delete(node);
+            }
+        }
+
+        void *allocate(size_t size)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (_block_size == 0 && size >= sizeof(Node))
+                    _block_size = size;
+                if (size == _block_size && _free)
+                {
+                    Node *node = _free;
+                    _free = node->next;
+                    _free_count--;
+                    return node;
+                }
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate(void *p, size_t size)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (size == _block_size && _free_count < _max_free)
+                {
+                    Node *node = (Node *)p;
+                    node->next = _free;
+                    _free = node;
+                    _free_count++;
+                    return;
+                }
+            }
+            ::operator delete(p);
+        }
+    };
+
+    // 基于BlockPool的分配器，配合std::allocate_shared使用时，对象和引用计数控制块会一起从内存池中分配
+    template <typename T>
+    class PoolAllocator
+    {
+    public:
+        using value_type = T;
+
+        PoolAllocator(const BlockPool::ptr &pool) : _pool(pool) {}
+
+        template <typename U>
+        PoolAllocator(const PoolAllocator<U> &other) : _pool(other.pool()) {}
+
+        T *allocate(size_t n)
+        {
+            return (T *)_pool->allocate(n * sizeof(T));
+        }
+
+        void deallocate(T *p, size_t n)
+        {
+            _pool->deallocate(p, n * sizeof(T));
         }
+
+        const BlockPool::ptr &pool() const
+        {
+            return _pool;
+        }
+
+        template <typename U>
+        bool operator==(const PoolAllocator<U> &other) const
+        {
+            return _pool == other.pool();
+        }
+
+        template <typename U>
+        bool operator!=(const PoolAllocator<U> &other) const
+        {
+            return _pool != other.pool();
+        }
+
+    private:
+        BlockPool::ptr _pool; // 内存池的生命周期由所有分配出去的对象共同维护
     };
+};
+
+// 主题名称的通配符匹配
+namespace util_ns
+{
+    // 主题名称按'.'分成多级，例如 orders.eu.created
+    // 订阅时可以使用通配符：'*'匹配任意一级，'#'匹配剩余的零级或多级，'#'只能作为最后一级
+    class TopicName
+    {
+    public:
+        static const char separator = '.';
+
+        static std::vector<std::string> split(const std::string &name)
+        {
+            std::vector<std::string> levels;
+            size_t start = 0;
+            while (true)
+            {
+                size_t pos = name.find(separator, start);
+                if (pos == std::string::npos)
+                {
+                    levels.push_back(name.substr(start));
+                    break;
+                }
+                levels.push_back(name.substr(start, pos - start));
+                start = pos + 1;
+            }
+            return levels;
+        }
+
+        // 判断名称中是否包含通配符，每条消息都会调用，直接扫描字符串不做拆分
+        static bool isPattern(const std::string &name)
+        {
+            size_t start = 0;
+            while (start <= name.size())
+            {
+                size_t end = name.find(separator, start);
+                if (end == std::string::npos)
+                    end = name.size();
+                if (end - start == 1 && (name[start] == '*' || name[start] == '#'))
+                    return true;
+                start = end + 1;
+            }
+            return false;
+        }
+
+        // 判断订阅的模式是否合法：'#'只能出现在最后一级
+        static bool validPattern(const std::string &pattern)
+        {
+            std::vector<std::string> levels = split(pattern);
+            for (size_t i = 0; i + 1 < levels.size(); i++)
+            {
+                if (levels[i] == "#")
+                    return false;
+            }
+            return true;
+        }
 
-};
\ No newline at end of file
+        // 判断主题名称是否与模式匹配
+        static bool match(const std::string &pattern, const std::string &name)
+        {
+            std::vector<std::string> p = split(pattern);
+            std::vector<std::string> n = split(name);
+            size_t i = 0;
+            for (; i < p.size(); i++)
+            {
+                if (p[i] == "#")
+                    return true;
+                if (i >= n.size() || (p[i] != "*" && p[i] != n[i]))
+                    return false;
+            }
+            return i == n.size();
+        }
+    };
+
+    // 通配符模式的匹配树，每个节点对应模式中的一级，值挂在模式最后一级对应的节点上
+    // 查找时沿主题名称逐级向下，只访问与名称匹配的分支，不需要逐个匹配所有的模式
+    // 不加锁，由使用者保证线程安全
+    template <typename T>
+    class TopicTrie
+    {
+    private:
+        struct Node
+        {
+            std::unordered_map<std::string, std::unique_ptr<Node>> children;
+            std::vector<T> values;
+        };
+        Node _root;
+        size_t _size = 0; // 挂在树上的值的数量
+
+    public:
+        // 添加模式对应的值，已经存在时返回false
+        bool insert(const std::string &pattern, const T &value)
+        {
+            Node *node = &_root;
+            for (auto &level : TopicName::split(pattern))
+            {
+                std::unique_ptr<Node> &child = node->children[level];
+                if (!child)
+                    child.reset(new Node());
+                node = child.get();
+            }
+            if (std::find(node->values.begin(), node->values.end(), value) != node->values.end())
+                return false;
+            node->values.push_back(value);
+            _size++;
+            return true;
+        }
+
+        // 删除模式对应的值，同时删除不再使用的节点，不存在时返回false
+        bool remove(const std::string &pattern, const T &value)
+        {
+            bool removed = false;
+            removeFrom(&_root, TopicName::split(pattern), 0, value, removed);
+            return removed;
+        }
+
+        // 查找与主题名称匹配的所有模式的值，同一个值可能通过多个模式匹配而出现多次
+        void match(const std::string &name, std::vector<T> &out) const
+        {
+            if (_size == 0)
+                return;
+            collect(&_root, TopicName::split(name), 0, out);
+        }
+
+        size_t size() const
+        {
+            return _size;
+        }
+
+    private:
+        // 返回节点是否已经为空
+        bool removeFrom(Node *node, const std::vector<std::string> &levels, size_t i, const T &value, bool &removed)
+        {
+            if (i == levels.size())
+            {
+                auto it = std::find(node->values.begin(), node->values.end(), value);
+                if (it != node->values.end())
+                {
+                    node->values.erase(it);
+                    _size--;
+                    removed = true;
+                }
+            }
+            else
+            {
+                auto it = node->children.find(levels[i]);
+                if (it != node->children.end() && removeFrom(it->second.get(), levels, i + 1, value, removed))
+                    node->children.erase(it);
+            }
+            return node->children.empty() && node->values.empty();
+        }
+
+        static void collect(const Node *node, const std::vector<std::string> &levels, size_t i, std::vector<T> &out)
+        {
+            // '#'只能是模式的最后一级，匹配剩余的零级或多级
+            auto it = node->children.find("#");
+            if (it != node->children.end())
+                out.insert(out.end(), it->second->values.begin(), it->second->values.end());
+            if (i == levels.size())
+            {
+                out.insert(out.end(), node->values.begin(), node->values.end());
+                return;
+            }
+            it = node->children.find(levels[i]);
+            if (it != node->children.end())
+                collect(it->second.get(), levels, i + 1, out);
+            it = node->children.find("*");
+            if (it != node->children.end())
+                collect(it->second.get(), levels, i + 1, out);
+        }
+    };
+};
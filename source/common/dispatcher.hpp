@@ -69,12 +69,20 @@ namespace util_ns
         void onMessage(const BaseConnection::ptr& conn, BaseMessage::ptr& msg)
         {
             // 找到消息类型对应的业务处理函数，调用即可
-            std::unique_lock<std::mutex> lock(_mutex);
-            auto it = _handlers.find(msg->mtype());
-            if(it != _handlers.end())
+            // 只在查找时加锁，调用业务函数时不持有锁，避免多个I/O线程在这里串行化
+            Callback::ptr cb;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                auto it = _handlers.find(msg->mtype());
+                if(it != _handlers.end())
+                {
+                    cb = it->second;
+                }
+            }
+            if(cb)
             {
                 // 找到了,直接调用对应的函数
-                it->second->onMessage(conn, msg);
+                cb->onMessage(conn, msg);
                 return;
             }
             LOG(FATAL, "收到未知类型消息");
@@ -5,9 +5,9 @@
 /*
     应用层自定义协议格式
     Len         4B  数据包长度
-    mtype       4B  消息类型，如rpc请求/响应类型、主题创建/删除等类型
-    idlength    4B  描述ID字段的实际长度
-    MID             用于唯一标识消息，长度不固定
+    mtype       4B  低16位为消息类型，如rpc请求/响应类型、主题创建/删除等类型
+                    高16位为正文的编码方式，0为json，兼容没有编码标志的旧报文
+    MID         8B  用于唯一标识消息，64位整形，网络字节序
     body            数据包的正文字段
 
 */
@@ -22,6 +22,15 @@ namespace util_ns
 #define KEY_TOPIC_KEY "topic_key"   // 主题名称
 #define KEY_TOPIC_MSG "topic_msg"   // 主题信息
 #define KEY_OPTYPE "optype"         // 主题操作类型
+#define KEY_TOPIC_POLICY "policy"   // 主题的慢消费者处理策略，创建主题时可选
+#define KEY_TOPIC_QUEUE "queue_size" // 每个订阅者等待发送的消息上限，创建主题时可选
+#define KEY_TOPIC_RETAIN "retention" // 主题在内存中保留的最近消息数量，创建主题时可选
+#define KEY_TOPIC_OFFSET "offset"   // 消息的偏移量：发布响应和推送中表示消息的偏移量，订阅时表示从该偏移量开始回放
+#define KEY_TOPIC_LAST "last"       // 订阅时回放最近的多少条消息
+#define KEY_TOPIC_DURABLE "durable" // 是否持久化主题的消息，创建主题时可选
+#define KEY_TOPIC_BATCH "batch"     // 批量发布/订阅的条目数组，每个条目包含主题名称以及消息内容或订阅参数
+#define KEY_TOPIC_OFFSETS "offsets" // 批量发布响应中每条消息的偏移量，与请求中的条目一一对应
+#define KEY_TOPIC_QOS "qos"         // 发布的服务质量：0表示服务端不发送确认，没有设置时为1
 #define KEY_HOST "host"             // 主机名称
 #define KEY_HOST_IP "ip"                 // 主机ip地址
 #define KEY_HOST_PORT "port"             // 主机端口
@@ -47,6 +56,17 @@ namespace util_ns
         RSP_SERVICE
     };
 
+    // 消息正文的编码方式
+    /*
+    • json文本
+    • 紧凑的二进制编码(MessagePack)
+    */
+    enum class CodecType
+    {
+        CODEC_JSON = 0,
+        CODEC_BINARY
+    };
+
     // 响应码类型定义
     /*
     • 成功处理
@@ -58,6 +78,7 @@ namespace util_ns
     • 无效的Topic操作类型
     • 主题不存在
     • 无效的服务操作类型
+    • 服务器繁忙，任务队列已满
     */
 
     enum class RCode
@@ -71,7 +92,9 @@ namespace util_ns
         RCODE_NOT_FOUND_SERVICE,
         RCODE_INVALID_OPTYPE,
         RCODE_NOT_FOUND_TOPIC,
-        RCODE_INTERNAL_ERROR
+        RCODE_INTERNAL_ERROR,
+        RCODE_SERVER_BUSY,
+        RCODE_TIMEOUT
     };
     static std::string errReason(RCode code)
     {
@@ -85,7 +108,9 @@ namespace util_ns
             {RCode::RCODE_NOT_FOUND_SERVICE, "没有找到对应的服务！"},
             {RCode::RCODE_INVALID_OPTYPE, "无效的操作类型"},
             {RCode::RCODE_NOT_FOUND_TOPIC, "没有找到对应的主题！"},
-            {RCode::RCODE_INTERNAL_ERROR, "内部错误！"}};
+            {RCode::RCODE_INTERNAL_ERROR, "内部错误！"},
+            {RCode::RCODE_SERVER_BUSY, "服务器繁忙！"},
+            {RCode::RCODE_TIMEOUT, "请求超时！"}};
         auto it = err_map.find(code);
         if (it == err_map.end())
         {
@@ -113,6 +138,8 @@ namespace util_ns
         主题订阅
         主题取消订阅
         主题消息发布
+        批量发布消息（一个或多个主题）
+        批量订阅主题
     */
     enum class TopicOptype
     {
@@ -120,7 +147,24 @@ namespace util_ns
         TOPIC_REMOVE,
         TOPIC_SUBSCRIBE,
         TOPIC_CANCEL,
-        TOPIC_PUBLISH
+        TOPIC_PUBLISH,
+        TOPIC_PUBLISH_BATCH,
+        TOPIC_SUBSCRIBE_BATCH
+    };
+
+    // 订阅者的等待队列满时的处理策略
+    /*
+        丢弃队列中最早的消息
+        丢弃新消息
+        断开订阅者的连接
+        拒绝发布者的新消息，直到订阅者消费掉积压的消息
+    */
+    enum class TopicPolicy
+    {
+        POLICY_DROP_OLDEST = 0,
+        POLICY_DROP_NEWEST,
+        POLICY_DISCONNECT,
+        POLICY_BLOCK
     };
 
     // 服务操作类型
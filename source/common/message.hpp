@@ -6,6 +6,42 @@
 
 namespace util_ns
 {
+    // 把缓冲区适配成编码器的输出目标
+    // MsgPack通过push_back/append写入，json通过绑定了该streambuf的输出流写入，数据都直接追加到缓冲区末尾
+    class BufferSink : public std::streambuf
+    {
+    private:
+        BaseBuffer *_out;
+
+    public:
+        BufferSink() : _out(nullptr) {}
+        void reset(BaseBuffer *out)
+        {
+            _out = out;
+        }
+        void push_back(char c)
+        {
+            _out->append(&c, 1);
+        }
+        void append(const char *data, size_t len)
+        {
+            _out->append(data, len);
+        }
+
+    protected:
+        virtual int_type overflow(int_type c) override
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()) == false)
+                push_back(traits_type::to_char_type(c));
+            return traits_type::not_eof(c);
+        }
+        virtual std::streamsize xsputn(const char *data, std::streamsize len) override
+        {
+            append(data, (size_t)len);
+            return len;
+        }
+    };
+
     class JsonMessage : public BaseMessage
     {
         // 使用protected保证继承的类也可以访问
@@ -17,20 +53,60 @@ namespace util_ns
 
         // 序列化
         virtual std::string serialize() override
+        {
+            return serialize(CodecType::CODEC_JSON);
+        }
+        // 按指定的编码方式序列化
+        virtual std::string serialize(CodecType codec) override
         {
             std::string body;
-            auto ret = JSON::Serialize(_body, body);
+            bool ret = false;
+            if (codec == CodecType::CODEC_BINARY)
+                ret = MsgPack::Serialize(_body, body);
+            else
+                ret = JSON::Serialize(_body, body);
             if (ret == false)
             {
-                return nullptr;
+                return std::string();
             }
             return body;
         }
+        // 按指定的编码方式把正文直接追加到缓冲区
+        virtual bool serialize(CodecType codec, BaseBuffer &out) override
+        {
+            // 输出流的构造开销较大，每个线程只构造一次，每次只重新绑定目标缓冲区
+            static thread_local BufferSink sink;
+            static thread_local std::ostream os(&sink);
+            sink.reset(&out);
+            bool ret = false;
+            if (codec == CodecType::CODEC_BINARY)
+            {
+                ret = MsgPack::SerializeTo(_body, sink);
+            }
+            else
+            {
+                os.clear();
+                ret = JSON::Serialize(_body, os);
+            }
+            sink.reset(nullptr);
+            return ret;
+        }
         // 反序列化
         virtual bool unserialize(const std::string &msg)
         {
             return JSON::UnSerialize(msg, _body);
         }
+        virtual bool unserialize(const char *data, size_t len)
+        {
+            return JSON::UnSerialize(data, len, _body);
+        }
+        // 按指定的编码方式反序列化
+        virtual bool unserialize(const char *data, size_t len, CodecType codec) override
+        {
+            if (codec == CodecType::CODEC_BINARY)
+                return MsgPack::UnSerialize(data, len, _body);
+            return JSON::UnSerialize(data, len, _body);
+        }
         // 反序列化后对信息进行校验
         virtual bool check() = 0;
     };
@@ -136,24 +212,44 @@ namespace util_ns
         {
             // topic请求，需要确认是否存在主题名称、消息内容及操作方法和格式是否正确
             // 以及在发布主题时消息内容是否为空
-            if (_body[KEY_TOPIC_KEY].isNull() == true ||
-                _body[KEY_TOPIC_KEY].isString() == false)
-            {
-                LOG(FATAL, "主题请求中没有主题名称或主题名称类型错误!\n");
-                return false;
-            }
             if (_body[KEY_OPTYPE].isNull() ||
                 _body[KEY_OPTYPE].isIntegral() == false)
             {
                 LOG(FATAL, "主题请求中没有操作类型或操作类型的类型错误!\n")
                 return false;
             }
+            // 批量请求的主题名称在各个条目中
+            if (isBatch())
+            {
+                return checkBatch();
+            }
+            if (_body[KEY_TOPIC_KEY].isNull() == true ||
+                _body[KEY_TOPIC_KEY].isString() == false)
+            {
+                LOG(FATAL, "主题请求中没有主题名称或主题名称类型错误!\n");
+                return false;
+            }
             if (_body[KEY_OPTYPE].asInt() == (int)TopicOptype::TOPIC_PUBLISH &&
                 (_body[KEY_TOPIC_MSG].isNull() == true ||
                  _body[KEY_TOPIC_MSG].isString() == false))
             {
                 LOG(FATAL, "主题消息发布请求中没有消息内容字段或消息内容类型错误!\n")
             }
+            if ((_body[KEY_TOPIC_POLICY].isNull() == false && _body[KEY_TOPIC_POLICY].isIntegral() == false) ||
+                (_body[KEY_TOPIC_QUEUE].isNull() == false && _body[KEY_TOPIC_QUEUE].isIntegral() == false) ||
+                (_body[KEY_TOPIC_QOS].isNull() == false && _body[KEY_TOPIC_QOS].isIntegral() == false))
+            {
+                LOG(FATAL, "主题请求中的流量控制字段类型错误!\n");
+                return false;
+            }
+            if ((_body[KEY_TOPIC_RETAIN].isNull() == false && _body[KEY_TOPIC_RETAIN].isUInt64() == false) ||
+                (_body[KEY_TOPIC_OFFSET].isNull() == false && _body[KEY_TOPIC_OFFSET].isUInt64() == false) ||
+                (_body[KEY_TOPIC_LAST].isNull() == false && _body[KEY_TOPIC_LAST].isUInt64() == false) ||
+                (_body[KEY_TOPIC_DURABLE].isNull() == false && _body[KEY_TOPIC_DURABLE].isBool() == false))
+            {
+                LOG(FATAL, "主题请求中的消息保留字段类型错误!\n");
+                return false;
+            }
             return true;
         }
 
@@ -192,6 +288,171 @@ namespace util_ns
         {
             _body[KEY_TOPIC_MSG] = msg;
         }
+
+        // 获取/设置慢消费者处理策略，没有设置时默认丢弃最早的消息
+        TopicPolicy policy()
+        {
+            if (_body[KEY_TOPIC_POLICY].isNull())
+                return TopicPolicy::POLICY_DROP_OLDEST;
+            return (TopicPolicy)_body[KEY_TOPIC_POLICY].asInt();
+        }
+
+        void setPolicy(TopicPolicy policy)
+        {
+            _body[KEY_TOPIC_POLICY] = (int)policy;
+        }
+
+        // 获取/设置订阅者等待队列的上限，没有设置时返回0，由服务端决定
+        size_t queueSize()
+        {
+            if (_body[KEY_TOPIC_QUEUE].isNull() || _body[KEY_TOPIC_QUEUE].isUInt64() == false)
+                return 0;
+            return (size_t)_body[KEY_TOPIC_QUEUE].asUInt64();
+        }
+
+        void setQueueSize(size_t size)
+        {
+            _body[KEY_TOPIC_QUEUE] = (Json::UInt64)size;
+        }
+
+        // 获取/设置主题保留的最近消息数量，没有设置时为0，表示不保留
+        size_t retention()
+        {
+            if (_body[KEY_TOPIC_RETAIN].isNull())
+                return 0;
+            return (size_t)_body[KEY_TOPIC_RETAIN].asUInt64();
+        }
+
+        void setRetention(size_t count)
+        {
+            _body[KEY_TOPIC_RETAIN] = (Json::UInt64)count;
+        }
+
+        // 获取/设置消息的偏移量
+        bool hasOffset()
+        {
+            return _body[KEY_TOPIC_OFFSET].isNull() == false;
+        }
+
+        uint64_t offset()
+        {
+            return _body[KEY_TOPIC_OFFSET].asUInt64();
+        }
+
+        void setOffset(uint64_t offset)
+        {
+            _body[KEY_TOPIC_OFFSET] = (Json::UInt64)offset;
+        }
+
+        // 获取/设置订阅时回放的最近消息数量，没有设置时为0
+        size_t lastCount()
+        {
+            if (_body[KEY_TOPIC_LAST].isNull())
+                return 0;
+            return (size_t)_body[KEY_TOPIC_LAST].asUInt64();
+        }
+
+        void setLastCount(size_t count)
+        {
+            _body[KEY_TOPIC_LAST] = (Json::UInt64)count;
+        }
+
+        // 获取/设置是否持久化主题的消息，没有设置时不持久化
+        bool durable()
+        {
+            return _body[KEY_TOPIC_DURABLE].isBool() && _body[KEY_TOPIC_DURABLE].asBool();
+        }
+
+        void setDurable(bool on)
+        {
+            _body[KEY_TOPIC_DURABLE] = on;
+        }
+
+        // 获取/设置发布的服务质量，QoS 0的发布请求不需要服务端确认，发布失败时也不会得到通知
+        int qos()
+        {
+            return _body[KEY_TOPIC_QOS].isIntegral() ? _body[KEY_TOPIC_QOS].asInt() : 1;
+        }
+
+        void setQos(int qos)
+        {
+            _body[KEY_TOPIC_QOS] = qos;
+        }
+
+        // 是否是不需要确认的发布请求
+        bool noAck()
+        {
+            TopicOptype type = optype();
+            return qos() == 0 && (type == TopicOptype::TOPIC_PUBLISH || type == TopicOptype::TOPIC_PUBLISH_BATCH);
+        }
+
+        // 是否是批量发布/订阅请求
+        bool isBatch()
+        {
+            TopicOptype type = optype();
+            return type == TopicOptype::TOPIC_PUBLISH_BATCH || type == TopicOptype::TOPIC_SUBSCRIBE_BATCH;
+        }
+
+        // 批量请求中的条目数量
+        size_t batchSize()
+        {
+            return _body[KEY_TOPIC_BATCH].size();
+        }
+
+        // 添加一条批量发布的消息
+        void appendPublish(const std::string &key, const std::string &msg)
+        {
+            Json::Value item;
+            item[KEY_TOPIC_KEY] = key;
+            item[KEY_TOPIC_MSG] = msg;
+            _body[KEY_TOPIC_BATCH].append(item);
+        }
+
+        // 添加一个批量订阅的主题，可以携带回放参数(offset/last)
+        void appendSubscribe(const std::string &key, const Json::Value &params = Json::Value(Json::objectValue))
+        {
+            Json::Value item = params;
+            item[KEY_TOPIC_KEY] = key;
+            _body[KEY_TOPIC_BATCH].append(item);
+        }
+
+        // 把第i个条目构造成单个的发布/订阅请求，请求id与批量请求相同
+        TopicRequest::ptr batchItem(size_t i)
+        {
+            auto item = std::make_shared<TopicRequest>();
+            item->SetMytype(mtype());
+            item->SetId(rid());
+            item->_body = _body[KEY_TOPIC_BATCH][(Json::ArrayIndex)i];
+            TopicOptype type = optype() == TopicOptype::TOPIC_PUBLISH_BATCH ? TopicOptype::TOPIC_PUBLISH 
+                                                                            : TopicOptype::TOPIC_SUBSCRIBE;
+            item->setOptype(type);
+            return item;
+        }
+
+    private:
+        bool checkBatch()
+        {
+            const Json::Value &batch = _body[KEY_TOPIC_BATCH];
+            if (batch.isArray() == false || (_body[KEY_TOPIC_QOS].isNull() == false && _body[KEY_TOPIC_QOS].isIntegral() == false))
+            {
+                LOG(FATAL, "批量主题请求中没有条目数组!\n");
+                return false;
+            }
+            bool publish = optype() == TopicOptype::TOPIC_PUBLISH_BATCH;
+            for (Json::ArrayIndex i = 0; i < batch.size(); i++)
+            {
+                const Json::Value &item = batch[i];
+                if (item.isObject() == false || item[KEY_TOPIC_KEY].isString() == false ||
+                    (publish && item[KEY_TOPIC_MSG].isString() == false) ||
+                    (item[KEY_TOPIC_OFFSET].isNull() == false && item[KEY_TOPIC_OFFSET].isUInt64() == false) ||
+                    (item[KEY_TOPIC_LAST].isNull() == false && item[KEY_TOPIC_LAST].isUInt64() == false))
+                {
+                    LOG(FATAL, "批量主题请求中的条目格式错误!\n");
+                    return false;
+                }
+            }
+            return true;
+        }
     };
 
     typedef std::pair<std::string, int> Address;
@@ -315,6 +576,44 @@ namespace util_ns
     {
     public:
         using ptr = std::shared_ptr<TopicResponse>;
+
+        // 发布响应中携带消息的偏移量
+        bool hasOffset()
+        {
+            return _body[KEY_TOPIC_OFFSET].isUInt64();
+        }
+
+        uint64_t offset()
+        {
+            return _body[KEY_TOPIC_OFFSET].asUInt64();
+        }
+
+        void setOffset(uint64_t offset)
+        {
+            _body[KEY_TOPIC_OFFSET] = (Json::UInt64)offset;
+        }
+
+        // 批量发布响应中每条消息的偏移量
+        std::vector<uint64_t> offsets()
+        {
+            std::vector<uint64_t> result;
+            const Json::Value &offsets = _body[KEY_TOPIC_OFFSETS];
+            for (Json::ArrayIndex i = 0; i < offsets.size(); i++)
+            {
+                result.push_back(offsets[i].asUInt64());
+            }
+            return result;
+        }
+
+        void setOffsets(const std::vector<uint64_t> &offsets)
+        {
+            Json::Value arr(Json::arrayValue);
+            for (uint64_t offset : offsets)
+            {
+                arr.append((Json::UInt64)offset);
+            }
+            _body[KEY_TOPIC_OFFSETS] = arr;
+        }
     };
 
     // Service响应
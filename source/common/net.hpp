@@ -12,6 +12,13 @@
 #include <memory>
 #include <mutex>
 #include <unordered_map>
+#include <atomic>
+#include <vector>
+#include <random>
+#include <future>
+#include <deque>
+#include <thread>
+#include <endian.h>
 
 #include "abstract.hpp"
 #include "fields.hpp"
@@ -57,6 +64,90 @@ namespace util_ns
         {
             return _buf->retrieveAsString(len);
         }
+        // 获取可读数据的起始地址
+        virtual const char *peek() override
+        {
+            return _buf->peek();
+        }
+        // 删除指定长度的数据
+        virtual void retrieve(size_t len) override
+        {
+            _buf->retrieve(len);
+        }
+        // 在可读数据的末尾追加数据
+        virtual void append(const char *data, size_t len) override
+        {
+            _buf->append(data, len);
+        }
+        // 删除可读数据末尾指定长度的数据
+        virtual void unwrite(size_t len) override
+        {
+            _buf->unwrite(len);
+        }
+        // 以网络字节序改写可读区域中offset处的4个字节
+        virtual void pokeInt32(size_t offset, int32_t val) override
+        {
+            int32_t be32 = htonl(val);
+            memcpy(const_cast<char *>(_buf->peek()) + offset, &be32, sizeof(be32));
+        }
+    };
+
+    // 基于std::string的缓冲区，用于把报文编码到一块独立的内存中
+    class StringBuffer : public BaseBuffer
+    {
+    private:
+        std::string *_str;
+
+    public:
+        StringBuffer(std::string *str) : _str(str) {}
+
+        virtual size_t readableSize() override
+        {
+            return _str->size();
+        }
+        virtual int32_t peekInt32() override
+        {
+            int32_t be32 = 0;
+            memcpy(&be32, _str->data(), sizeof(be32));
+            return ntohl(be32);
+        }
+        virtual void retrieveInt32() override
+        {
+            retrieve(sizeof(int32_t));
+        }
+        virtual int32_t readInt32() override
+        {
+            int32_t val = peekInt32();
+            retrieveInt32();
+            return val;
+        }
+        virtual std::string retrieveAsString(size_t len) override
+        {
+            std::string result = _str->substr(0, len);
+            retrieve(len);
+            return result;
+        }
+        virtual const char *peek() override
+        {
+            return _str->data();
+        }
+        virtual void retrieve(size_t len) override
+        {
+            _str->erase(0, len);
+        }
+        virtual void append(const char *data, size_t len) override
+        {
+            _str->append(data, len);
+        }
+        virtual void unwrite(size_t len) override
+        {
+            _str->resize(_str->size() - len);
+        }
+        virtual void pokeInt32(size_t offset, int32_t val) override
+        {
+            int32_t be32 = htonl(val);
+            memcpy(&(*_str)[offset], &be32, sizeof(be32));
+        }
     };
 
     class BufferFactory
@@ -72,12 +163,14 @@ namespace util_ns
     class LVProtocol : public BaseProtocol
     {
     private:
-        const size_t lenFieldsLength = 4;
-        const size_t mtypeFieldsLength = 4;
-        const size_t idlenFieldsLength = 4;
+        static const size_t lenFieldsLength = 4;
+        static const size_t mtypeFieldsLength = 4;
+        static const size_t ridFieldsLength = 8;
+        static const int codecFieldsShift = 16; // mtype字段的高16位表示正文编码方式
+        static const int32_t maxFrameLength = 16 * 1024 * 1024; // Len字段允许的最大值
 
     public:
-        // |--Len--|--mtype--|--idlen--|--id--|--body--|
+        // |--Len--|--mtype--|--id--|--body--|
         // Len表示消息总长度，不包括字节的4字节
         using ptr = std::shared_ptr<BaseProtocol>;
         // 判断缓冲区中能否取出一条完整的数据包
@@ -88,59 +181,127 @@ namespace util_ns
                 return false;
             }
             int32_t total_len = buf->peekInt32();
-            if (buf->readableSize() < (total_len + lenFieldsLength))
+            // 长度字段非法时交给onMessage拒绝并断开连接，不再等待永远不会到齐的数据
+            if (validLength(total_len) == false)
+            {
+                return true;
+            }
+            if (buf->readableSize() < ((size_t)total_len + lenFieldsLength))
             {
                 return false;
             }
             return true;
         }
+        // Len至少要包含mtype和id字段，并且不超过最大报文长度
+        static bool validLength(int32_t total_len)
+        {
+            return total_len >= (int32_t)(mtypeFieldsLength + ridFieldsLength) && total_len <= maxFrameLength;
+        }
         // 从缓冲区中取出完整的数据包，参数1为缓冲区，参数2为输出的msg
+        // 直接在缓冲区的可读区域上解析，消息构建完成后才把数据从缓冲区中删除
         virtual bool onMessage(const BaseBuffer::ptr &buf, BaseMessage::ptr &msg) override
         {
             // 当调用onMessage的时候，默认认为缓冲区中的数据足够一条完整的消息
-            int32_t total_len = buf->readInt32();                                         // 获取总长度
-            MType mtype = (MType)buf->readInt32();                                        // 获取消息类型
-            int32_t idlen = buf->readInt32();                                             // 获取id长度
-            int32_t body_len = total_len - idlen - idlenFieldsLength - mtypeFieldsLength; // 获取正文长度
-            std::string id = buf->retrieveAsString(idlen);
-            std::string body = buf->retrieveAsString(body_len);
+            const char *data = buf->peek();
+            int32_t total_len = readInt32(data);                                            // 获取总长度
+            if (validLength(total_len) == false)
+            {
+                LOG(FATAL, "消息长度字段错误：%d\n", total_len);
+                return false;
+            }
+            int32_t type_field = readInt32(data + lenFieldsLength);                         // 获取消息类型和编码方式
+            MType mtype = (MType)(type_field & 0xFFFF);
+            CodecType codec = (CodecType)((uint32_t)type_field >> codecFieldsShift);
+            uint64_t rid = readUInt64(data + lenFieldsLength + mtypeFieldsLength);          // 获取id
+            int32_t body_len = total_len - (int32_t)(mtypeFieldsLength + ridFieldsLength);  // 获取正文长度
+            if (codec != CodecType::CODEC_JSON && codec != CodecType::CODEC_BINARY)
+            {
+                LOG(FATAL, "未知的正文编码方式！\n");
+                return false;
+            }
+            const char *body = data + lenFieldsLength + mtypeFieldsLength + ridFieldsLength;
             msg = MessageFactory::create(mtype);
             if (msg.get() == nullptr)
             {
                 LOG(FATAL, "消息类型错误，构造消息对象失败！\n");
                 return false;
             }
-            bool ret = msg->unserialize(body);
+            bool ret = msg->unserialize(body, body_len, codec);
             if (ret == false)
             {
                 LOG(FATAL, "消息正文反序列化失败！\n");
                 return false;
             }
-            msg->SetId(id);
+            msg->SetId(rid);
             msg->SetMytype(mtype);
+            msg->setCodec(codec);
+            buf->retrieve(lenFieldsLength + total_len);
             return true;
         }
         // 发送消息时对其进行序列化, 注意对前三个字段从主机字节序转换成网络字节序
-        virtual std::string serialize(const BaseMessage::ptr &msg)
+        virtual std::string serialize(const BaseMessage::ptr &msg) override
+        {
+            return serialize(msg, CodecType::CODEC_JSON);
+        }
+        // 按指定的正文编码方式进行序列化，编码方式记录在mtype字段的高16位
+        virtual std::string serialize(const BaseMessage::ptr &msg, CodecType codec) override
         {
-            // |--Len--|--mtype--|--idlen--|--id--|--body--|
-            std::string body = msg->serialize();
-            std::string id = msg->rid();
-            auto mtype = htonl((int32_t)msg->mtype());
-            int32_t idlen = htonl(id.size());
-            int32_t h_total_len = mtypeFieldsLength + idlenFieldsLength + id.size() + body.size(); // 主机字节序
-            int32_t n_total_len = htonl(h_total_len);                                              // 网络字节序
+            // |--Len--|--mtype--|--id--|--body--|
+            std::string body = msg->serialize(codec);
+            auto mtype = htonl((int32_t)msg->mtype() | ((int32_t)codec << codecFieldsShift));
+            uint64_t rid = htobe64(msg->rid());
+            int32_t h_total_len = mtypeFieldsLength + ridFieldsLength + body.size(); // 主机字节序
+            int32_t n_total_len = htonl(h_total_len);                                // 网络字节序
 
             std::string result;
             result.reserve(h_total_len + lenFieldsLength);
             result.append((char *)&n_total_len, lenFieldsLength);
             result.append((char *)&mtype, mtypeFieldsLength);
-            result.append((char *)&idlen, idlenFieldsLength);
-            result.append(id);
+            result.append((char *)&rid, ridFieldsLength);
             result.append(body);
 
             return result;
         }
+        // 把报文直接编码到缓冲区末尾，不生成任何中间字符串
+        // 正文长度在编码完成前是未知的，先为Len字段占位，正文写完后再回填
+        // 缓冲区中可能已经有其他待发送的报文，所以不能使用缓冲区头部的prepend空间
+        virtual bool serialize(const BaseMessage::ptr &msg, CodecType codec, BaseBuffer &out) override
+        {
+            // |--Len--|--mtype--|--id--|--body--|
+            size_t start = out.readableSize();
+            char head[lenFieldsLength + mtypeFieldsLength + ridFieldsLength];
+            int32_t mtype = htonl((int32_t)msg->mtype() | ((int32_t)codec << codecFieldsShift));
+            uint64_t rid = htobe64(msg->rid());
+            memset(head, 0, lenFieldsLength);
+            memcpy(head + lenFieldsLength, &mtype, mtypeFieldsLength);
+            memcpy(head + lenFieldsLength + mtypeFieldsLength, &rid, ridFieldsLength);
+            out.append(head, sizeof(head));
+            if (msg->serialize(codec, out) == false)
+            {
+                // 撤销写入了一半的报文，避免破坏缓冲区中的其他报文
+                out.unwrite(out.readableSize() - start);
+                return false;
+            }
+            int32_t total_len = (int32_t)(out.readableSize() - start - lenFieldsLength);
+            out.pokeInt32(start, total_len);
+            return true;
+        }
+
+    private:
+        // 从内存中读取一个网络字节序的4字节整形
+        static int32_t readInt32(const char *data)
+        {
+            int32_t be32 = 0;
+            memcpy(&be32, data, sizeof(be32));
+            return ntohl(be32);
+        }
+        // 从内存中读取一个网络字节序的8字节整形
+        static uint64_t readUInt64(const char *data)
+        {
+            uint64_t be64 = 0;
+            memcpy(&be64, data, sizeof(be64));
+            return be64toh(be64);
+        }
     };
 
     class ProtocolFactory
@@ -153,34 +314,262 @@ namespace util_ns
         }
     };
 
+    // 把消息编码成可以直接发送的完整报文
+    // 同一条消息需要发给多个连接时，每种正文编码方式只编码一次，之后各连接通过sendRaw共享同一份报文
+    class FrameFactory
+    {
+    public:
+        static Frame create(const BaseMessage::ptr &msg, CodecType codec)
+        {
+            LVProtocol protocol;
+            std::string frame;
+            StringBuffer out(&frame);
+            if (protocol.serialize(msg, codec, out) == false)
+            {
+                return Frame();
+            }
+            return std::make_shared<const std::string>(std::move(frame));
+        }
+    };
+
+    // 一条消息按编码方式缓存的报文，第一次需要某种编码方式时才编码
+    // 可以在多个线程之间共享，用于同一条消息分批发给不同连接的情况
+    class FrameCache
+    {
+    private:
+        BaseMessage::ptr _msg;
+        std::mutex _mutex;
+        Frame _frames[2]; // 按CodecType下标保存
+
+    public:
+        using ptr = std::shared_ptr<FrameCache>;
+
+        FrameCache(const BaseMessage::ptr &msg) : _msg(msg) {}
+
+        // 获取指定编码方式的报文，编码失败时返回空
+        Frame get(CodecType codec)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            Frame &frame = _frames[codec == CodecType::CODEC_BINARY ? 1 : 0];
+            if (!frame)
+                frame = FrameFactory::create(_msg, codec);
+            return frame;
+        }
+    };
+
+    // 发送批处理
+    // 报文先追加到待发送缓冲区中，同一轮事件循环内的报文由一次任务合并成一次send发出，
+    // 减少业务线程发送时的跨线程唤醒以及write系统调用的次数
+    // 1. 缓冲区达到max_bytes时立即发送
+    // 2. delay_us为0时在连接所属EventLoop的本轮循环结束时发送，否则最多等待delay_us后发送
+    class SendBatcher : public std::enable_shared_from_this<SendBatcher>
+    {
+    private:
+        const size_t _max_bytes;             // 缓冲区达到该大小时立即发送
+        const int _delay_us;                 // 最长等待时间(us)
+        muduo::net::TcpConnectionPtr _conn;  // 发送使用的TCP连接
+        std::mutex _mutex;                   // 保护待发送缓冲区
+        muduo::net::Buffer _buffer;          // 待发送的报文
+        bool _scheduled;                     // 是否已经安排了发送任务
+
+    public:
+        using ptr = std::shared_ptr<SendBatcher>;
+
+        SendBatcher(const muduo::net::TcpConnectionPtr &conn, size_t max_bytes, int delay_us)
+            : _max_bytes(max_bytes), _delay_us(delay_us), _conn(conn), _scheduled(false)
+        {}
+
+        // 追加一个编码好的报文
+        void append(const char *data, size_t len)
+        {
+            bool schedule = false;
+            bool full = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _buffer.append(data, len);
+                schedule = markScheduled();
+                full = _buffer.readableBytes() >= _max_bytes;
+            }
+            afterAppend(schedule, full);
+        }
+
+        // 把消息直接编码到待发送缓冲区中，不生成中间字符串
+        bool append(const BaseProtocol::ptr &protocol, const BaseMessage::ptr &msg, CodecType codec)
+        {
+            bool schedule = false;
+            bool full = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                MuduoBuffer out(&_buffer);
+                if (protocol->serialize(msg, codec, out) == false)
+                {
+                    LOG(FATAL, "消息序列化失败！\n");
+                    return false;
+                }
+                schedule = markScheduled();
+                full = _buffer.readableBytes() >= _max_bytes;
+            }
+            afterAppend(schedule, full);
+            return true;
+        }
+
+        // 立即发送缓冲区中的报文
+        void flush()
+        {
+            auto self = shared_from_this();
+            _conn->getLoop()->runInLoop([self]()
+                                        { self->flushInLoop(); });
+        }
+
+        // 先发送缓冲区中的报文再断开连接，force为true时立即关闭，不等待输出缓冲区中的数据发送完
+        // 连接进入断开状态后底层不再发送数据，因此发送和断开要在I/O线程中按顺序执行
+        void close(bool force)
+        {
+            auto self = shared_from_this();
+            _conn->getLoop()->runInLoop([self, force]()
+                                        {
+                self->flushInLoop();
+                if (force)
+                    self->_conn->forceClose();
+                else
+                    self->_conn->shutdown(); });
+        }
+
+    private:
+        // 需要持有锁调用，返回是否需要由调用者安排发送任务
+        bool markScheduled()
+        {
+            if (_scheduled)
+                return false;
+            _scheduled = true;
+            return true;
+        }
+
+        void afterAppend(bool schedule, bool full)
+        {
+            if (full)
+            {
+                flush();
+            }
+            else if (schedule)
+            {
+                auto self = shared_from_this();
+                if (_delay_us > 0)
+                    _conn->getLoop()->runAfter(_delay_us / 1000000.0, [self]()
+                                               { self->flushInLoop(); });
+                else
+                    _conn->getLoop()->queueInLoop([self]()
+                                                  { self->flushInLoop(); });
+            }
+        }
+
+        void flushInLoop()
+        {
+            muduo::net::Buffer out;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                out.swap(_buffer);
+                _scheduled = false;
+            }
+            // 在所属I/O线程中发送，缓冲区中的所有报文合并为一次写入
+            if (out.readableBytes() > 0 && _conn->connected())
+                _conn->send(&out);
+        }
+    };
+
     class MuduoConnection : public BaseConnection
     {
     private:
         BaseProtocol::ptr _protocol;
         muduo::net::TcpConnectionPtr _conn;
+        std::atomic<CodecType> _codec; // 发送消息时正文使用的编码方式
+        SendBatcher::ptr _batcher;     // 发送批处理
+        std::atomic<bool> _writable;   // 输出缓冲区是否低于高水位
+        std::mutex _mutex;             // 保护可写回调
+        std::function<void()> _cb_writable; // 连接重新变为可写时的回调
 
     public:
-        MuduoConnection(const muduo::net::TcpConnectionPtr &conn, const BaseProtocol::ptr &protocol)
-            : _conn(conn), _protocol(protocol)
+        MuduoConnection(const muduo::net::TcpConnectionPtr &conn, const BaseProtocol::ptr &protocol,
+                        size_t batch_bytes = 64 * 1024, int batch_delay_us = 0)
+            : _conn(conn), _protocol(protocol), _codec(CodecType::CODEC_JSON),
+              _batcher(std::make_shared<SendBatcher>(conn, batch_bytes, batch_delay_us)), _writable(true)
         {}
 
         using ptr = std::shared_ptr<MuduoConnection>;
         // 发送消息
+        // 可能在业务线程中被调用：报文编码后放入批处理缓冲区，由连接所属的loop合并发送
         virtual void send(const BaseMessage::ptr &msg) override
         {
-            std::string body = _protocol->serialize(msg);
-            _conn->send(body);
+            _batcher->append(_protocol, msg, _codec.load(std::memory_order_relaxed));
         };
-        // 断开连接
+        // 发送编码好的报文，只拷贝到批处理缓冲区，不再编码
+        virtual void sendRaw(const Frame &frame) override
+        {
+            _batcher->append(frame->data(), frame->size());
+        }
+        // 立即发送批处理缓冲区中的报文
+        virtual void flush() override
+        {
+            _batcher->flush();
+        }
+        // 断开连接，批处理缓冲区中的报文先发送出去
         virtual void shutdown() override
         {
-            _conn->shutdown();
+            _batcher->close(false);
+        }
+        // 立即断开连接，丢弃输出缓冲区中的数据
+        virtual void forceClose() override
+        {
+            _batcher->close(true);
         }
         // 判断连接状态
         virtual bool connected() override
         {
             return _conn->connected();
         }
+        // 输出缓冲区是否低于高水位
+        virtual bool writable() override
+        {
+            return _writable.load(std::memory_order_acquire);
+        }
+        virtual void setWritableCallback(const std::function<void()> &cb) override
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cb_writable = cb;
+        }
+        // 以下两个接口由服务器在连接所属的I/O线程中调用
+        // 输出缓冲区超过高水位
+        void onHighWaterMark()
+        {
+            _writable.store(false, std::memory_order_release);
+        }
+        // 输出缓冲区中的数据全部发送完毕
+        void onWriteComplete()
+        {
+            if (_writable.exchange(true, std::memory_order_acq_rel))
+                return;
+            std::function<void()> cb;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                cb = _cb_writable;
+            }
+            if (cb)
+                cb();
+        }
+        // 设置/获取发送消息时正文使用的编码方式
+        virtual void setCodec(CodecType codec) override
+        {
+            _codec.store(codec, std::memory_order_relaxed);
+        }
+        virtual CodecType codec() override
+        {
+            return _codec.load(std::memory_order_relaxed);
+        }
+        // 判断当前线程是否是连接所属的I/O线程
+        virtual bool inLoopThread() override
+        {
+            return _conn->getLoop()->isInLoopThread();
+        }
     };
 
     class ConnectionFactory
@@ -197,18 +586,25 @@ namespace util_ns
     {
     private:
         const size_t maxDataSize = (1 << 16); // 最大数据量
-        muduo::net::EventLoop _baseloop;      // 事件监听
+        muduo::net::EventLoop _baseloop;      // 事件监听，只负责接受新连接（设置了I/O线程时）
         muduo::net::TcpServer _server;        // 服务器
-        std::mutex _mutex;
+        std::mutex _mutex;                    // 只在连接建立/断开时使用，收发消息的路径上不加锁
         BaseProtocol::ptr _protocol;                                                  // 自定义协议处理工具
         std::unordered_map<muduo::net::TcpConnectionPtr, BaseConnection::ptr> _conns; // 管理连接
     public:
         using ptr = std::shared_ptr<MuduoServer>;
 
-        MuduoServer(int port)
+        // io_threads为I/O线程数量，连接会被轮转分配到各个I/O线程的EventLoop上
+        // 为0时所有连接的读写都在_baseloop上完成
+        MuduoServer(int port, int io_threads = 0)
             : _server(&_baseloop, muduo::net::InetAddress("0.0.0.0", port), "MuduoServer", muduo::net::TcpServer::kReusePort), 
             _protocol(ProtocolFactory::create())
-        {}
+        {
+            if (io_threads > 0)
+            {
+                _server.setThreadNum(io_threads);
+            }
+        }
 
         // 服务器启动
         virtual void start() override
@@ -233,7 +629,26 @@ namespace util_ns
                 LOG(INFO, "连接建立\n");
                 // 创建新的MuduoConnection并添加进_conns进行管理
                 // 可能有多个连接同时到来，上锁保证线程安全
-                auto muduo_conn = ConnectionFactory::create(conn, _protocol);
+                auto muduo_conn = ConnectionFactory::create(conn, _protocol, _batch_bytes, _batch_delay_us);
+                // 把连接对象挂到TcpConnection的上下文中，收到消息时直接取出，不再查表加锁
+                conn->setContext(muduo_conn);
+                // 输出缓冲区超过高水位时标记为不可写，之后等到缓冲区中的数据全部发送完再恢复
+                // 只在超过高水位后才设置发送完成回调，避免每次发送都触发一次回调
+                std::weak_ptr<MuduoConnection> weak_conn = std::static_pointer_cast<MuduoConnection>(muduo_conn);
+                conn->setHighWaterMarkCallback([weak_conn](const muduo::net::TcpConnectionPtr &tcp_conn, size_t)
+                {
+                    auto self = weak_conn.lock();
+                    if (!self)
+                        return;
+                    self->onHighWaterMark();
+                    tcp_conn->setWriteCompleteCallback([weak_conn](const muduo::net::TcpConnectionPtr &tcp_conn)
+                    {
+                        tcp_conn->setWriteCompleteCallback(muduo::net::WriteCompleteCallback());
+                        auto self = weak_conn.lock();
+                        if (self)
+                            self->onWriteComplete();
+                    });
+                }, _high_water_mark);
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     _conns.insert(std::make_pair(conn, muduo_conn));
@@ -246,7 +661,8 @@ namespace util_ns
             else
             {
                 LOG(INFO, "连接断开\n");
-                // 删除对连接的管理
+                // 删除对连接的管理，同时解除TcpConnection上下文对连接对象的引用
+                conn->setContext(boost::any());
                 BaseConnection::ptr muduo_conn;
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
@@ -256,10 +672,11 @@ namespace util_ns
                         return;
                     }
                     muduo_conn = it->second;
-                    // 调用连接处理函数
-                    if (_cb_close)
-                        _cb_close(muduo_conn);
+                    _conns.erase(it);
                 }
+                // 调用连接处理函数，不持有_mutex，避免阻塞其他I/O线程上的连接建立/断开
+                if (_cb_close)
+                    _cb_close(muduo_conn);
             }
         }
 
@@ -293,17 +710,18 @@ namespace util_ns
                     return;
                 }
                 // 反序列化成功，获得数据
-                BaseConnection::ptr base_conn;
-
+                // 连接对象保存在TcpConnection的上下文中，由所属I/O线程独占访问，无需加锁
+                const BaseConnection::ptr *base_conn_ptr = boost::any_cast<BaseConnection::ptr>(&conn->getContext());
+                if (base_conn_ptr == nullptr || *base_conn_ptr == nullptr)
                 {
-                    std::unique_lock<std::mutex> lock(_mutex);
-                    auto it = _conns.find(conn);
-                    if (it == _conns.end())
-                    {
-                        conn->shutdown();
-                        return;
-                    }
-                    base_conn = it->second;
+                    conn->shutdown();
+                    return;
+                }
+                BaseConnection::ptr base_conn = *base_conn_ptr;
+                // 正文编码方式按连接协商：对端用什么编码发送请求，就用什么编码进行响应
+                if (base_conn->codec() != msg->codec())
+                {
+                    base_conn->setCodec(msg->codec());
                 }
                 // 调用消息处理回调函数
                 if (_cb_message)
@@ -322,44 +740,382 @@ namespace util_ns
         }
     };
 
+    // 客户端的I/O线程池
+    // 多个客户端共享固定数量的EventLoop线程，不再每个客户端单独启动一个线程
+    // 默认所有客户端都使用进程内共享的线程池，线程数量与CPU核数相同，不会随连接数量增长
+    class ClientLoopPool
+    {
+    private:
+        std::atomic<size_t> _next;                                          // 用于RR轮转选择EventLoop
+        std::vector<std::unique_ptr<muduo::net::EventLoopThread>> _threads; // I/O线程
+        std::vector<muduo::net::EventLoop *> _loops;                        // 对应的EventLoop
+    public:
+        using ptr = std::shared_ptr<ClientLoopPool>;
+
+        ClientLoopPool(int nthreads)
+            : _next(0)
+        {
+            if (nthreads <= 0)
+                nthreads = 1;
+            for (int i = 0; i < nthreads; i++)
+            {
+                _threads.emplace_back(new muduo::net::EventLoopThread());
+                _loops.push_back(_threads.back()->startLoop());
+            }
+        }
+
+        // 按RR轮转获取一个EventLoop
+        muduo::net::EventLoop *nextLoop()
+        {
+            return _loops[_next.fetch_add(1, std::memory_order_relaxed) % _loops.size()];
+        }
+
+        size_t size()
+        {
+            return _loops.size();
+        }
+
+        // 进程内共享的客户端I/O线程池，第一次使用时创建
+        static ptr instance()
+        {
+            static ptr pool = std::make_shared<ClientLoopPool>((int)std::thread::hardware_concurrency());
+            return pool;
+        }
+    };
+
+    // 在线程池的一个EventLoop上周期性执行的定时任务，生命周期与对象相同
+    // 不依附于任何连接，连接的创建和销毁不会影响它；析构时在EventLoop中同步取消，之后回调不会再执行
+    class LoopTimer
+    {
+    private:
+        ClientLoopPool::ptr _loops;       // 持有线程池，保证EventLoop在定时任务之后析构
+        muduo::net::EventLoop *_loop;
+        muduo::net::TimerId _timer;
+
+    public:
+        using ptr = std::shared_ptr<LoopTimer>;
+
+        LoopTimer(const ClientLoopPool::ptr &loops, double interval, const std::function<void()> &cb)
+            : _loops(loops), _loop(_loops->nextLoop())
+        {
+            _timer = _loop->runEvery(interval, cb);
+        }
+
+        ~LoopTimer()
+        {
+            muduo::CountDownLatch latch(1);
+            _loop->runInLoop([this, &latch]()
+                             {
+                _loop->cancel(_timer);
+                latch.countDown(); });
+            latch.wait();
+        }
+    };
+
+    // 客户端使用的连接
+    // 对象在客户端的整个生命周期内保持不变，底层的TCP连接在建立/断开时替换，上层持有的连接对象不会失效
+    // TCP连接建立之前发送的消息先放入等待队列，连接建立后按顺序发送
+    class ClientConnection : public BaseConnection
+    {
+    public:
+        enum class State
+        {
+            CONNECTING, // 正在连接，发送的消息进入等待队列
+            CONNECTED,  // 已连接
+            CLOSED      // 未连接，消息无法发送
+        };
+
+    private:
+        // 等待连接建立的消息，msg和frame二者只有一个有效
+        struct Pending
+        {
+            BaseMessage::ptr msg;
+            Frame frame;
+        };
+        const size_t _max_pending;             // 等待队列的上限
+        BaseProtocol::ptr _protocol;           // 自定义协议处理工具
+        muduo::net::EventLoop *_loop;          // 所属的EventLoop
+        std::atomic<CodecType> _codec;         // 发送消息时正文使用的编码方式
+        std::atomic<State> _state;             // 连接状态，只在持有_mutex时修改
+        std::mutex _mutex;                     // 保护底层连接和等待队列
+        muduo::net::TcpConnectionPtr _conn;    // 当前的TCP连接，未连接时为空
+        SendBatcher::ptr _batcher;             // 当前TCP连接的发送批处理，未连接时为空
+        std::deque<Pending> _pending;          // 等待连接建立的消息
+        size_t _batch_bytes;                   // 发送批处理参数，建立TCP连接时使用
+        int _batch_delay_us;
+
+    public:
+        using ptr = std::shared_ptr<ClientConnection>;
+
+        ClientConnection(const BaseProtocol::ptr &protocol, muduo::net::EventLoop *loop, size_t max_pending = 4096)
+            : _max_pending(max_pending), _protocol(protocol), _loop(loop),
+              _codec(CodecType::CODEC_JSON), _state(State::CLOSED),
+              _batch_bytes(64 * 1024), _batch_delay_us(0)
+        {}
+
+        // 发送消息，正在连接时先放入等待队列
+        virtual void send(const BaseMessage::ptr &msg) override
+        {
+            SendBatcher::ptr batcher = batcherOrQueue(Pending{msg, Frame()});
+            if (batcher)
+                batcher->append(_protocol, msg, codec());
+        }
+        // 发送编码好的报文，正在连接时同样先放入等待队列
+        virtual void sendRaw(const Frame &frame) override
+        {
+            SendBatcher::ptr batcher = batcherOrQueue(Pending{BaseMessage::ptr(), frame});
+            if (batcher)
+                batcher->append(frame->data(), frame->size());
+        }
+        // 立即发送批处理缓冲区中的报文
+        virtual void flush() override
+        {
+            SendBatcher::ptr batcher;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                batcher = _batcher;
+            }
+            if (batcher)
+                batcher->flush();
+        }
+        // 断开连接，批处理缓冲区中的报文先发送出去
+        virtual void shutdown() override
+        {
+            close(false);
+        }
+        // 立即断开连接，不等待输出缓冲区中的数据发送完
+        virtual void forceClose() override
+        {
+            close(true);
+        }
+        // 判断连接是否可用：已经建立或正在建立（消息会先排队）
+        virtual bool connected() override
+        {
+            return _state.load() != State::CLOSED;
+        }
+        // 判断TCP连接是否已经建立
+        bool established()
+        {
+            return _state.load() == State::CONNECTED;
+        }
+        // 设置/获取发送消息时正文使用的编码方式
+        virtual void setCodec(CodecType codec) override
+        {
+            _codec.store(codec, std::memory_order_relaxed);
+        }
+        virtual CodecType codec() override
+        {
+            return _codec.load(std::memory_order_relaxed);
+        }
+        // 判断当前线程是否是连接所属的I/O线程
+        virtual bool inLoopThread() override
+        {
+            return _loop->isInLoopThread();
+        }
+
+        // 以下接口由客户端调用
+        // 设置发送批处理参数，下次建立TCP连接时生效
+        void setSendBatch(size_t max_bytes, int delay_us)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _batch_bytes = max_bytes;
+            _batch_delay_us = delay_us;
+        }
+        // 开始连接，之后发送的消息进入等待队列，已经建立连接时不做处理
+        void connecting()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_state == State::CLOSED)
+                _state = State::CONNECTING;
+        }
+        // TCP连接建立，先按顺序发送等待队列中的消息，之后的消息直接发送
+        void attach(const muduo::net::TcpConnectionPtr &conn)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _batcher = std::make_shared<SendBatcher>(conn, _batch_bytes, _batch_delay_us);
+            for (auto &pending : _pending)
+            {
+                if (pending.frame)
+                    _batcher->append(pending.frame->data(), pending.frame->size());
+                else
+                    _batcher->append(_protocol, pending.msg, codec());
+            }
+            _pending.clear();
+            _conn = conn;
+            _state = State::CONNECTED;
+        }
+        // TCP连接断开或连接失败，丢弃等待队列中的消息，对应的请求由上层以连接断开结束
+        void detach()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _conn.reset();
+            _batcher.reset();
+            _pending.clear();
+            _state = State::CLOSED;
+        }
+
+    private:
+        void close(bool force)
+        {
+            SendBatcher::ptr batcher;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                batcher = _batcher;
+            }
+            if (batcher)
+                batcher->close(force);
+        }
+
+        // 正在连接时把消息放入等待队列并返回空，否则返回当前连接的发送批处理对象
+        SendBatcher::ptr batcherOrQueue(Pending &&pending)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_state == State::CONNECTING)
+            {
+                if (_pending.size() >= _max_pending)
+                {
+                    LOG(WARING, "等待连接建立的消息过多，丢弃消息\n");
+                    return SendBatcher::ptr();
+                }
+                _pending.push_back(std::move(pending));
+                return SendBatcher::ptr();
+            }
+            if (!_batcher)
+            {
+                LOG(WARING, "连接已断开，消息发送失败\n");
+            }
+            return _batcher;
+        }
+    };
+
     class MuduoClient : public BaseClient
     {
     private:
         const size_t maxDataSize = (1 << 16);    // 最大数据量
-        BaseConnection::ptr _conn;               // 连接对象
-        muduo::CountDownLatch _downlatch;        // 同步计数
-        muduo::net::EventLoopThread _loopthread; // 监听线程（epoll）
-        muduo::net::EventLoop *_baseloop;        // 对应的指针
-        muduo::net::TcpClient _client;           // 客户端
+        const double timerInterval = 0.01;       // 定时回调的间隔(s)
+        const int backoffBaseMs = 100;           // 连接重试的初始等待时间(ms)
+        const int reconnectBaseMs = 1000;        // 连接断开后第一次重连的最大等待时间(ms)
+        const int backoffMaxMs = 10000;          // 连接重试的最大等待时间(ms)
+        ClientLoopPool::ptr _loops;              // 持有所使用的线程池，保证EventLoop在客户端之后析构
+        muduo::net::EventLoop *_baseloop;        // 监听（epoll）使用的EventLoop
+        muduo::net::InetAddress _server_addr;    // 服务器地址
         BaseProtocol::ptr _protocol;             // 处理自定义协议工具
+        ClientConnection::ptr _conn;             // 连接对象，整个生命周期内不变
+        // 以下成员只在I/O线程中访问
+        std::unique_ptr<muduo::net::TcpClient> _client;    // 客户端，每次连接尝试都使用新的TcpClient
+        std::shared_ptr<bool> _guard;                      // 定时任务通过它判断客户端是否已经析构
+        std::vector<ConnectDoneCallback> _connect_cbs;     // 等待连接结果的回调
+        bool _connecting;                        // 是否正在连接
+        bool _reconnecting;                      // 是否是连接断开后的自动重连，重连会一直重试直到成功
+        bool _stopped;                           // 是否已经主动关闭连接，主动关闭后不再重连
+        int _attempts;                           // 本轮连接已经尝试的次数
+        uint64_t _attempt_id;                    // 当前连接尝试的编号，用于忽略过期的超时任务
+        bool _timer_started;                     // 是否已经启动了定时任务
+        muduo::net::TimerId _timer;              // 定时任务，析构时需要取消
     public:
         using ptr = std::shared_ptr<MuduoClient>;
         
+        // 从进程内共享的客户端I/O线程池中按RR轮转分配EventLoop
         MuduoClient(const std::string &sip, int sport)
-        : _baseloop(_loopthread.startLoop()),
-          _downlatch(1), // 初始化为1，因为为0时wait()才会唤醒
-          _client(_baseloop, muduo::net::InetAddress(sip, sport), "MuduoClient"),
-          _protocol(ProtocolFactory::create())
+        : MuduoClient(sip, sport, ClientLoopPool::instance())
         {}
 
-        // 连接服务器
-        virtual void connect() override
+        // 从指定的线程池中分配EventLoop
+        MuduoClient(const std::string &sip, int sport, const ClientLoopPool::ptr &loops)
+        : _loops(loops),
+          _baseloop(_loops->nextLoop()),
+          _server_addr(sip, sport),
+          _protocol(ProtocolFactory::create()),
+          _conn(std::make_shared<ClientConnection>(_protocol, _baseloop)),
+          _guard(std::make_shared<bool>(true)),
+          _connecting(false),
+          _reconnecting(false),
+          _stopped(false),
+          _attempts(0),
+          _attempt_id(0),
+          _timer_started(false)
+        {}
+
+        ~MuduoClient()
         {
-            LOG(INFO, "设置回调函数，连接服务器\n");
-            // 设置连接事件（连接建立/管理）的回调
-            _client.setConnectionCallback(std::bind(&MuduoClient::onConnection, this, std::placeholders::_1));
-            // 设置连接消息的回调
-            _client.setMessageCallback(std::bind(&MuduoClient::onMessage, this,std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            // EventLoop被其他客户端共享，析构后它仍会继续运行
+            // 因此要在EventLoop中同步取消定时任务，并解除连接上绑定了this的回调，之后的事件不会再访问本对象
+            muduo::CountDownLatch latch(1);
+            _baseloop->runInLoop([this, &latch]()
+                                 {
+                _guard.reset();
+                if (_timer_started)
+                    _baseloop->cancel(_timer);
+                if (_client)
+                {
+                    muduo::net::TcpConnectionPtr conn = _client->connection();
+                    if (conn)
+                    {
+                        conn->setConnectionCallback([](const muduo::net::TcpConnectionPtr &) {});
+                        conn->setMessageCallback([](const muduo::net::TcpConnectionPtr &, muduo::net::Buffer *buf, muduo::Timestamp)
+                                                 { buf->retrieveAll(); });
+                    }
+                    // 连接仍然建立着时，通知上层结束这个连接上未完成的请求，之后不会再收到它们的响应
+                    if (_conn->established() && _cb_close)
+                        _cb_close(_conn);
+                    // 先释放对TCP连接的引用，TcpClient析构时才会关闭连接
+                    _conn->detach();
+                    _client.reset();
+                }
+                finishConnect(false);
+                latch.countDown(); });
+            latch.wait();
+        }
 
-            // 连接服务器
-            _client.connect();
-            _downlatch.wait();
-            LOG(INFO, "服务器连接成功\n");
+        // 连接服务器，阻塞直到连接成功或所有连接尝试都失败
+        virtual void connect() override
+        {
+            // I/O线程是共享的，在同一个线程中等待连接建立会导致死锁，此时只发起连接，不等待
+            if (_baseloop->isInLoopThread())
+            {
+                LOG(WARING, "在客户端的I/O线程中连接服务器，不等待连接建立\n");
+                connect(ConnectDoneCallback());
+                return;
+            }
+            auto result = std::make_shared<std::promise<bool>>();
+            std::future<bool> done = result->get_future();
+            connect([result](bool ok)
+                    { result->set_value(ok); });
+            if (done.get())
+            {
+                LOG(INFO, "服务器连接成功\n");
+            }
+            else
+            {
+                LOG(WARING, "服务器连接失败\n");
+            }
+        }
+        // 异步连接服务器，不阻塞调用者，连接成功或所有连接尝试都失败后调用cb
+        // 连接建立之前发送的消息会先排队，连接建立后再发送
+        virtual void connect(const ConnectDoneCallback &cb) override
+        {
+            LOG(INFO, "连接服务器\n");
+            _conn->connecting();
+            _baseloop->runInLoop(std::bind(&MuduoClient::startConnect, this, cb));
         }
         // 关闭连接
         virtual void shutdown() override
         {
-            _client.disconnect();
+            _baseloop->runInLoop([this]()
+                                 {
+                _stopped = true;
+                if (_connecting)
+                {
+                    // 还没有连接成功（或正在重连），放弃连接
+                    _client.reset();
+                    finishConnect(false);
+                }
+                else if (_client)
+                {
+                    // 先发送批处理缓冲区中的报文再断开
+                    _conn->shutdown();
+                    _client->disconnect();
+                } });
         }
         // 发送消息
         virtual bool send(const BaseMessage::ptr& msg) override
@@ -373,33 +1129,193 @@ namespace util_ns
             LOG(INFO, "成功发送数据\n");
             return true;
         }
-        // 获取当前连接
+        // 设置发送消息时正文使用的编码方式
+        virtual void setCodec(CodecType codec) override
+        {
+            BaseClient::setCodec(codec);
+            _conn->setCodec(codec);
+        }
+        // 设置连接的发送批处理参数
+        virtual void setSendBatch(size_t max_bytes, int delay_us) override
+        {
+            BaseClient::setSendBatch(max_bytes, delay_us);
+            _conn->setSendBatch(max_bytes, delay_us);
+        }
+        // 获取当前连接，连接对象在客户端的整个生命周期内不变
         virtual BaseConnection::ptr connection() override
         {
             return _conn;
         }
-        // 判断连接状态
+        // 判断连接是否可用：已经建立或正在建立
         virtual bool connected() override
         {
-            return (_conn && _conn->connected());
+            return _conn->connected();
         }
     private:
+        // 以下接口都在I/O线程中执行
+        void startConnect(const ConnectDoneCallback &cb)
+        {
+            // 设置定时任务，即使连接断开也会继续运行，保证等待中的请求能够超时
+            if (_cb_timer && _timer_started == false)
+            {
+                _timer = _baseloop->runEvery(timerInterval, _cb_timer);
+                _timer_started = true;
+            }
+            _stopped = false;
+            if (_conn->established())
+            {
+                if (cb)
+                    cb(true);
+                return;
+            }
+            if (cb)
+                _connect_cbs.push_back(cb);
+            if (_connecting)
+            {
+                // 正在自动重连时，主动发起的连接同样需要排队发送消息
+                _conn->connecting();
+                return;
+            }
+            _connecting = true;
+            _attempts = 0;
+            _conn->connecting();
+            attempt();
+        }
+
+        // 发起一次连接，超时未连接成功则放弃本次连接并按退避时间重试
+        void attempt()
+        {
+            _attempts++;
+            _client.reset(new muduo::net::TcpClient(_baseloop, _server_addr, "MuduoClient"));
+            // 设置连接事件（连接建立/管理）的回调
+            _client->setConnectionCallback(std::bind(&MuduoClient::onConnection, this, std::placeholders::_1));
+            // 设置连接消息的回调
+            _client->setMessageCallback(std::bind(&MuduoClient::onMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+            _client->connect();
+
+            uint64_t id = ++_attempt_id;
+            std::weak_ptr<bool> guard = _guard;
+            _baseloop->runAfter(_connect_timeout_ms / 1000.0, [this, guard, id]()
+                                {
+                if (guard.expired() || id != _attempt_id || _connecting == false)
+                    return;
+                LOG(WARING, "连接服务器超时，第 %d 次尝试\n", _attempts);
+                retry(); });
+        }
+
+        // 放弃当前的连接，重试次数用完则连接失败
+        void retry()
+        {
+            _client.reset();
+            ++_attempt_id;
+            // 主动发起的连接排在自动重连上时，重连会一直重试，不能让等待者等到重连成功
+            // 每次尝试失败都通知等待者，重连继续在后台进行
+            if (_reconnecting && _connect_cbs.empty() == false)
+                failWaiters();
+            if (_reconnecting == false && _connect_retries >= 0 && _attempts > _connect_retries)
+            {
+                finishConnect(false);
+                // 启用了自动重连时，通知等待者连接失败后继续在后台重连，直到连接成功或主动关闭
+                // 否则这个客户端再也不会连接成功，持有它的连接池只能拿到不可用的连接
+                if (_reconnect && _stopped == false)
+                    startReconnect();
+                return;
+            }
+            scheduleAttempt(backoff(_reconnecting ? reconnectBaseMs : backoffBaseMs, _attempts));
+        }
+
+        // 开始自动重连，重连会按退避时间一直重试直到成功
+        void startReconnect()
+        {
+            LOG(INFO, "准备重新连接服务器\n");
+            _connecting = true;
+            _reconnecting = true;
+            _attempts = 0;
+            scheduleAttempt(backoff(reconnectBaseMs, 1));
+        }
+
+        // 等待delay_ms后发起下一次连接
+        void scheduleAttempt(int delay_ms)
+        {
+            std::weak_ptr<bool> guard = _guard;
+            _baseloop->runAfter(delay_ms / 1000.0, [this, guard]()
+                                {
+                if (guard.expired() || _connecting == false)
+                    return;
+                attempt(); });
+        }
+
+        // 指数退避，等待时间在[0, base_ms * 2^(attempts-1)]中随机选择（不超过backoffMaxMs）
+        // 随机抖动使大量客户端在服务端恢复后分散重连，避免同时涌入
+        int backoff(int base_ms, int attempts)
+        {
+            static thread_local std::mt19937 gen(std::random_device{}());
+            int shift = attempts - 1 < 16 ? attempts - 1 : 16;
+            long long delay = (long long)base_ms << shift;
+            if (delay > backoffMaxMs)
+                delay = backoffMaxMs;
+            std::uniform_int_distribution<int> dist(0, (int)delay);
+            return dist(gen);
+        }
+
+        // 本轮连接结束，通知所有等待连接结果的回调
+        void finishConnect(bool ok)
+        {
+            bool was_connecting = _connecting;
+            _connecting = false;
+            _reconnecting = false;
+            if (ok == false && was_connecting)
+            {
+                failWaiters();
+                return;
+            }
+            std::vector<ConnectDoneCallback> cbs;
+            cbs.swap(_connect_cbs);
+            for (auto &cb : cbs)
+            {
+                cb(ok);
+            }
+        }
+
+        // 连接失败，等待队列中的消息被丢弃，通知上层结束对应的请求，再通知所有等待连接结果的回调
+        void failWaiters()
+        {
+            std::vector<ConnectDoneCallback> cbs;
+            cbs.swap(_connect_cbs);
+            _conn->detach();
+            if (_cb_close)
+                _cb_close(_conn);
+            for (auto &cb : cbs)
+            {
+                cb(false);
+            }
+        }
+
         // 当有新连接到来或连接断开
         void onConnection(const muduo::net::TcpConnectionPtr &conn)
         {
             if (conn->connected())
             {
                 LOG(INFO, "连接建立！\n");
-
-                // 真正用于发送数据的对象是TcpConnection，所以要设置TcpConnectionPtr
-                _conn = ConnectionFactory::create(conn, _protocol);
-                // 因为进行connect操作时是非阻塞的，为了保证连接完成后才能发送消息，使用countdownlatch进行同步
-                _downlatch.countDown(); // 计数--，为0时唤醒阻塞
+                ++_attempt_id; // 本次连接的超时任务失效
+                // 先发送连接建立之前排队的消息
+                _conn->attach(conn);
+                if (_cb_connection)
+                    _cb_connection(_conn);
+                finishConnect(true);
             }
             else
             {
                 LOG(INFO, "连接断开！\n");
-                _conn.reset();  // 连接清理
+                _conn->detach();
+                // 通知上层连接断开，上层需要处理这个连接上未完成的请求
+                if (_cb_close)
+                    _cb_close(_conn);
+                // 自动重连，重连期间连接不可用，发送的请求会立即失败，上层可以换一个服务提供者
+                // 重连成功后由连接建立的回调恢复注册、订阅等状态
+                // 当前正处于TcpClient的回调中，不能在这里析构它，下次连接时再替换
+                if (_reconnect && _stopped == false && _connecting == false)
+                    startReconnect();
             }
         }
 
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "detail.hpp"
+
+namespace util_ns
+{
+    // 业务处理线程池
+    // 每个工作线程拥有自己的有界任务队列，避免所有线程争抢同一把锁；
+    // I/O线程只负责解析报文并投递任务，真正的业务处理在工作线程中并行执行
+    class WorkerPool
+    {
+    public:
+        using ptr = std::shared_ptr<WorkerPool>;
+        using Task = std::function<void()>;
+
+    private:
+        // 工作线程的描述
+        struct Worker
+        {
+            std::mutex _mutex;
+            std::condition_variable _cond;
+            std::deque<Task> tasks; // 当前线程待执行的任务
+            bool running = false;
+            std::thread thread;
+        };
+
+        const size_t _max_queue_size;                 // 每个工作线程的任务队列上限
+        std::atomic<size_t> _next;                    // 用于RR轮转选择工作线程
+        std::vector<std::unique_ptr<Worker>> _workers; // 工作线程
+
+    public:
+        WorkerPool(int nthreads, size_t max_queue_size = 4096)
+            : _max_queue_size(max_queue_size), _next(0)
+        {
+            if (nthreads <= 0)
+                nthreads = 1;
+            for (int i = 0; i < nthreads; i++)
+            {
+                _workers.emplace_back(new Worker());
+            }
+        }
+
+        ~WorkerPool()
+        {
+            stop();
+        }
+
+        // 启动所有工作线程
+        void start()
+        {
+            for (auto &worker : _workers)
+            {
+                std::unique_lock<std::mutex> lock(worker->_mutex);
+                if (worker->running)
+                    continue;
+                worker->running = true;
+                worker->thread = std::thread(&WorkerPool::workerLoop, this, worker.get());
+            }
+        }
+
+        // 停止所有工作线程，已经投递的任务会被执行完
+        void stop()
+        {
+            for (auto &worker : _workers)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(worker->_mutex);
+                    worker->running = false;
+                }
+                worker->_cond.notify_all();
+            }
+            for (auto &worker : _workers)
+            {
+                if (worker->thread.joinable())
+                    worker->thread.join();
+            }
+        }
+
+        size_t size()
+        {
+            return _workers.size();
+        }
+
+        // 按RR轮转投递任务，目标线程队列已满时依次尝试其他线程
+        // 所有线程的队列都满了则返回false，由上层决定如何处理
+        bool post(Task task)
+        {
+            size_t start = _next.fetch_add(1, std::memory_order_relaxed);
+            for (size_t i = 0; i < _workers.size(); i++)
+            {
+                if (push(_workers[(start + i) % _workers.size()].get(), task))
+                    return true;
+            }
+            return false;
+        }
+
+        // 按key投递任务，相同key的任务总是由同一个线程按投递顺序执行
+        bool post(size_t key, Task task)
+        {
+            return push(_workers[key % _workers.size()].get(), task);
+        }
+
+    private:
+        bool push(Worker *worker, Task &task)
+        {
+            {
+                std::unique_lock<std::mutex> lock(worker->_mutex);
+                if (worker->running == false || worker->tasks.size() >= _max_queue_size)
+                    return false;
+                worker->tasks.push_back(std::move(task));
+            }
+            worker->_cond.notify_one();
+            return true;
+        }
+
+        void workerLoop(Worker *worker)
+        {
+            std::deque<Task> tasks;
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(worker->_mutex);
+                    worker->_cond.wait(lock, [worker]()
+                                       { return worker->running == false || worker->tasks.empty() == false; });
+                    if (worker->tasks.empty())
+                        return; // 已停止且任务全部执行完毕
+                    // 一次取走所有任务，减少加锁次数
+                    tasks.swap(worker->tasks);
+                }
+                for (auto &task : tasks)
+                {
+                    task();
+                }
+                tasks.clear();
+            }
+        }
+    };
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+namespace util_ns
+{
+    // 哈希时间轮，用于管理大量的超时任务
+    // 1. 添加任务：按到期时间计算所在的槽位，O(1)
+    // 2. 推进时间轮：由EventLoop的定时器周期性调用，只处理已经走过的槽位
+    //    推进时按实际流逝的时间计算槽位，多个EventLoop同时驱动也不会提前触发
+    // 3. 取消任务：add返回任务的句柄，任务提前完成时通过句柄从槽位中摘除，O(1)
+    //    每个槽位是一个双向链表，摘除的节点放回空闲链表复用，高请求速率下时间轮中只保留未完成的任务
+    class TimeWheel
+    {
+    public:
+        using ptr = std::shared_ptr<TimeWheel>;
+        using ExpireCallback = std::function<void(uint64_t)>;
+
+    private:
+        struct Entry
+        {
+            uint64_t id;          // 任务id
+            uint64_t expire_tick; // 到期时的刻度，超过一圈的任务靠它区分
+            bool active;          // 是否还在槽位中，节点回收后句柄失效
+            Entry *prev;
+            Entry *next;
+        };
+
+    public:
+        using Handle = Entry *;   // 任务句柄，只能用于cancel
+
+    private:
+        const int _tick_ms;    // 每个槽位代表的时间
+        ExpireCallback _cb;    // 任务到期的回调
+        std::mutex _mutex;
+        std::vector<Entry *> _slots; // 每个槽位链表的头节点
+        Entry *_free;                // 回收的节点
+        uint64_t _current_tick; // 已经处理到的刻度
+        std::chrono::steady_clock::time_point _start;
+
+    public:
+        TimeWheel(const ExpireCallback &cb, int tick_ms = 10, size_t slot_count = 512)
+            : _tick_ms(tick_ms > 0 ? tick_ms : 1), _cb(cb), _slots(slot_count > 0 ? slot_count : 1, nullptr),
+              _free(nullptr), _current_tick(0), _start(std::chrono::steady_clock::now())
+        {}
+
+        ~TimeWheel()
+        {
+            for (Entry *head : _slots)
+            {
+                release(head);
+            }
+            release(_free);
+        }
+
+        int tickMs()
+        {
+            return _tick_ms;
+        }
+
+        // 添加一个timeout_ms毫秒后到期的任务，返回用于取消任务的句柄
+        Handle add(uint64_t id, int timeout_ms)
+        {
+            uint64_t expire_tick = (elapsedMs() + timeout_ms + _tick_ms - 1) / _tick_ms;
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (expire_tick <= _current_tick)
+                expire_tick = _current_tick + 1;
+            Entry *entry = _free;
+            if (entry != nullptr)
+                _free = entry->next;
+            else
+                entry = new Entry();
+            entry->id = id;
+            entry->expire_tick = expire_tick;
+            entry->active = true;
+            Entry *&head = _slots[expire_tick % _slots.size()];
+            entry->prev = nullptr;
+            entry->next = head;
+            if (head != nullptr)
+                head->prev = entry;
+            head = entry;
+            return entry;
+        }
+
+        // 取消一个还没有到期的任务，任务已经到期或者已经取消时什么也不做
+        // 节点会被复用，因此同时比较任务id，防止误删复用该节点的新任务
+        void cancel(Handle handle, uint64_t id)
+        {
+            if (handle == nullptr)
+                return;
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (handle->active == false || handle->id != id)
+                return;
+            unlink(handle);
+            recycle(handle);
+        }
+
+        // 时间轮中还没有到期也没有取消的任务数量
+        size_t size()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            size_t n = 0;
+            for (Entry *head : _slots)
+            {
+                for (Entry *e = head; e != nullptr; e = e->next)
+                    n++;
+            }
+            return n;
+        }
+
+        // 推进时间轮，处理所有到期的任务
+        void advance()
+        {
+            std::vector<uint64_t> expired;
+            {
+                uint64_t now_tick = elapsedMs() / _tick_ms;
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (now_tick <= _current_tick)
+                    return;
+                // 间隔超过一圈时，每个槽位只需要处理一次
+                uint64_t from = _current_tick + 1;
+                if (now_tick - _current_tick > _slots.size())
+                    from = now_tick - _slots.size() + 1;
+                for (uint64_t tick = from; tick <= now_tick; tick++)
+                {
+                    Entry *entry = _slots[tick % _slots.size()];
+                    while (entry != nullptr)
+                    {
+                        Entry *next = entry->next;
+                        if (entry->expire_tick <= now_tick)
+                        {
+                            expired.push_back(entry->id);
+                            unlink(entry);
+                            recycle(entry);
+                        }
+                        entry = next;
+                    }
+                }
+                _current_tick = now_tick;
+            }
+            // 回调时不持有锁，回调中可以再次添加任务
+            for (uint64_t id : expired)
+            {
+                _cb(id);
+            }
+        }
+
+    private:
+        // 从所在槽位的链表中摘除，调用者需持有_mutex
+        void unlink(Entry *entry)
+        {
+            if (entry->prev != nullptr)
+                entry->prev->next = entry->next;
+            else
+                _slots[entry->expire_tick % _slots.size()] = entry->next;
+            if (entry->next != nullptr)
+                entry->next->prev = entry->prev;
+        }
+
+        void recycle(Entry *entry)
+        {
+            entry->active = false;
+            entry->prev = nullptr;
+            entry->next = _free;
+            _free = entry;
+        }
+
+        static void release(Entry *entry)
+        {
+            while (entry != nullptr)
+            {
+                Entry *next = entry->next;
+                delete entry;
+                entry = next;
+            }
+        }
+
+        uint64_t elapsedMs()
+        {
+            auto elapsed = std::chrono::steady_clock::now() - _start;
+            return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        }
+    };
+};
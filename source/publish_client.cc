@@ -13,9 +13,14 @@ int main()
     if (ret == false) {
         LOG(WARING, "创建主题失败！\n");
     }
-    //3. 向主题发布消息
+    //3. 向主题发布消息，批量发布只需要一次往返
+    std::vector<client::TopicManager::TopicMessage> batch;
     for (int i = 0; i < 10; i++) {
-        client->publish("hello", "Hello World-" + std::to_string(i));
+        batch.push_back(std::make_pair("hello", "Hello World-" + std::to_string(i)));
+    }
+    ret = client->publish(batch);
+    if (ret == false) {
+        LOG(WARING, "发布消息失败！\n");
     }
     client->shutdown();
     return 0;
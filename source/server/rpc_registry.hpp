@@ -217,7 +217,7 @@ namespace util_ns
                 // 构建通知报文
                 auto msg_req = MessageFactory::create<ServiceRequest>();
                 msg_req->SetMytype(MType::REQ_SERVICE);
-                msg_req->SetId(UUID::uuid());
+                msg_req->SetId(IDGenerator::nextId());
                 msg_req->setMethod(method);
                 msg_req->setHost(host);
                 msg_req->setOptype(optype);
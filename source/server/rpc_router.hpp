@@ -1,6 +1,7 @@
 #pragma once
 #include "../common/net.hpp"
 #include "../common/message.hpp"
+#include "../common/threadpool.hpp"
 
 namespace util_ns
 {
@@ -183,14 +184,42 @@ namespace util_ns
         {
         private:
             ServiceManager::ptr _service_manager;
+            WorkerPool::ptr _workers;   // 业务处理线程池，为空则直接在I/O线程中处理
         public:
             using ptr = std::shared_ptr<RpcRouter>;
 
-            RpcRouter():_service_manager(std::make_shared<ServiceManager>())
+            RpcRouter(const WorkerPool::ptr& workers = WorkerPool::ptr())
+                :_service_manager(std::make_shared<ServiceManager>()),
+                _workers(workers)
             {}
 
             //这是注册到Dispatcher模块针对rpc请求进行回调处理的业务函数
             void onRpcRequest(const BaseConnection::ptr &conn, RpcRequest::ptr &request)
+            {
+                if(_workers.get() == nullptr)
+                {
+                    return handleRequest(conn, request);
+                }
+                // 将业务处理投递到工作线程，I/O线程继续解析后续报文
+                // 业务处理完成后conn->send会把响应交回连接所属的I/O线程发送
+                RpcRequest::ptr req = request;
+                bool ret = _workers->post([this, conn, req]() { handleRequest(conn, req); });
+                if(ret == false)
+                {
+                    LOG(WARING, "业务线程任务队列已满，拒绝 %s 请求!\n", request->method().c_str());
+                    return response(conn, request, Json::Value(), RCode::RCODE_SERVER_BUSY);
+                }
+            }
+
+            // 服务注册
+             void registerMethod(const ServiceDescribe::ptr& service)
+            {
+                _service_manager->insert(service);
+            }
+        
+        private:
+            // 真正处理rpc请求，可能运行在I/O线程或者工作线程中
+            void handleRequest(const BaseConnection::ptr &conn, const RpcRequest::ptr &request)
             {
                 //1. 查询客户端请求的方法描述--判断当前服务端能否提供对应的服务
                 auto service = _service_manager->select(request->method());
@@ -217,13 +246,6 @@ namespace util_ns
                 return response(conn, request, result, RCode::RCODE_OK);
             }
 
-            // 服务注册
-             void registerMethod(const ServiceDescribe::ptr& service)
-            {
-                _service_manager->insert(service);
-            }
-        
-        private:
             void response(const BaseConnection::ptr &conn, const RpcRequest::ptr &req, const Json::Value &res, RCode rcode)
             {
                 auto msg = MessageFactory::create<RpcResponse>();
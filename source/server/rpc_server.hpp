@@ -19,14 +19,15 @@ namespace util_ns
         public:
             using ptr = std::shared_ptr<RegistryServer>;
 
-            RegistryServer(int port)
+            // io_threads为I/O线程数量，为0时所有连接都在一个EventLoop上处理
+            RegistryServer(int port, int io_threads = 0)
                 :_pd_manager(std::make_shared<PDManager>()),
                 _dispatcher(std::make_shared<Dispatcher>())
             {
                 auto service_cb = std::bind(&PDManager::onServiceRequest, _pd_manager.get(), std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->registerHandler<ServiceRequest>(MType::REQ_SERVICE, service_cb);
 
-                _server = ServerFactory::create(port);
+                _server = ServerFactory::create(port, io_threads);
                 auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
                 _server->setMessageCallback(message_cb);
 
@@ -54,6 +55,7 @@ namespace util_ns
             bool _enableRegistry;                       // 确认是否使用注册中心
             Address _access_addr;
             client::ReigstryClient::ptr _reg_client;    // 注册中心客户端
+            WorkerPool::ptr _workers;                   // 业务处理线程池
             RpcRouter::ptr _router;                     // Rpc服务管理
             Dispatcher::ptr _dispatcher;                // 管理数据包分发
             BaseServer::ptr _server;                // 服务器
@@ -63,10 +65,15 @@ namespace util_ns
             //rpc——server端有两套地址信息：
             //  1. rpc服务提供端地址信息--必须是rpc服务器对外访问地址（云服务器---监听地址和访问地址不同）
             //  2. 注册中心服务端地址信息 -- 启用服务注册后，连接注册中心进行服务注册用的
-            RpcServer(const Address& access_addr, bool enableRegistry = false, const Address& registry_server_addr = Address())
+            // worker_threads为业务处理线程数量，为0时业务回调直接在I/O线程中执行
+            // 启用业务线程后，注册的业务回调可能被多个线程同时调用，需要自行保证线程安全
+            // io_threads为I/O线程数量，为0时所有连接都在一个EventLoop上处理
+            RpcServer(const Address& access_addr, bool enableRegistry = false, const Address& registry_server_addr = Address(),
+                      int worker_threads = 0, int io_threads = 0)
                 :_enableRegistry(enableRegistry),
                 _access_addr(access_addr),
-                _router(std::make_shared<RpcRouter>()),
+                _workers(worker_threads > 0 ? std::make_shared<WorkerPool>(worker_threads) : WorkerPool::ptr()),
+                _router(std::make_shared<RpcRouter>(_workers)),
                 _dispatcher(std::make_shared<Dispatcher>())
             {
                 if(enableRegistry)
@@ -79,11 +86,21 @@ namespace util_ns
                 auto rpc_cb = std::bind(&RpcRouter::onRpcRequest, _router.get(), std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->registerHandler<RpcRequest>(MType::REQ_RPC, rpc_cb);
 
-                _server = ServerFactory::create(access_addr.second);
+                _server = ServerFactory::create(access_addr.second, io_threads);
                 auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
                 _server->setMessageCallback(message_cb);
             }
 
+            // 业务线程中的任务持有_router的裸指针，_router先于_workers析构
+            // 因此先停止业务线程，等待已经投递的任务执行完，再析构其他成员
+            ~RpcServer()
+            {
+                if(_workers)
+                {
+                    _workers->stop();
+                }
+            }
+
             // 方法注册
             void registerMethod(const ServiceDescribe::ptr& service)
             {
@@ -96,6 +113,10 @@ namespace util_ns
 
             void start()
             {
+                if(_workers)
+                {
+                    _workers->start();
+                }
                 _server->start();
             }
         };
@@ -104,20 +125,26 @@ namespace util_ns
         class TopicServer
         {
         private:
+            WorkerPool::ptr _workers;           // 消息推送线程池
             TopicManager::ptr _topic_manager;   // 主题管理
+            TopicStore::ptr _store;             // 持久化主题的存储
             Dispatcher::ptr _dispatcher;
             BaseServer::ptr _server;
         public:
             using ptr = std::shared_ptr<TopicServer>;
             
-            TopicServer(int port)
-                :_topic_manager(std::make_shared<TopicManager>()),
+            // io_threads为I/O线程数量，为0时所有连接都在一个EventLoop上处理
+            // worker_threads为消息推送线程数量，为0时在发布者连接的I/O线程中推送
+            // 启用推送线程后，订阅者被分散到各个推送线程上并行推送，发布请求在推送之前就会得到响应
+            TopicServer(int port, int io_threads = 0, int worker_threads = 0)
+                :_workers(worker_threads > 0 ? std::make_shared<WorkerPool>(worker_threads) : WorkerPool::ptr()),
+                _topic_manager(std::make_shared<TopicManager>(_workers)),
                 _dispatcher(std::make_shared<Dispatcher>())
             {
                 auto topic_cb = std::bind(&TopicManager::onTopicRequest, _topic_manager.get(), std::placeholders::_1, std::placeholders::_2);
                 _dispatcher->registerHandler<TopicRequest>(MType::REQ_TOPIC, topic_cb);
 
-                _server = ServerFactory::create(port);
+                _server = ServerFactory::create(port, io_threads);
                 auto message_cb = std::bind(&Dispatcher::onMessage, _dispatcher.get(), std::placeholders::_1, std::placeholders::_2);
                 _server->setMessageCallback(message_cb);
 
@@ -128,9 +155,32 @@ namespace util_ns
 
             void start()
             {
+                if(_workers)
+                {
+                    _workers->start();
+                }
                 _server->start();
             }
 
+            // 设置连接输出缓冲区的高水位，超过后推送给该订阅者的消息进入等待队列，需要在start()之前设置
+            void setHighWaterMark(size_t bytes)
+            {
+                _server->setHighWaterMark(bytes);
+            }
+
+            // 获取主题中因为订阅者消费过慢而被丢弃的消息数量
+            uint64_t dropped(const std::string& topic_name)
+            {
+                return _topic_manager->dropped(topic_name);
+            }
+
+            // 开启持久化主题，消息保存在data_dir目录下，并恢复目录中已有的主题，需要在start()之前调用
+            void enableDurable(const std::string& data_dir, const LogOptions& options = LogOptions())
+            {
+                _store = std::make_shared<TopicStore>(data_dir, options);
+                _topic_manager->enableDurable(_store);
+            }
+
         private:
             void onConnShutdown(const BaseConnection::ptr& conn)
             {
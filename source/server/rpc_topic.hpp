@@ -1,7 +1,10 @@
 #pragma once
 #include "../common/net.hpp"
 #include "../common/message.hpp"
+#include "../common/threadpool.hpp"
+#include "rpc_topic_log.hpp"
 #include <unordered_set>
+#include <deque>
 
 namespace util_ns
 {
@@ -11,17 +14,46 @@ namespace util_ns
         class TopicManager
         {
         private:
+            // 主题的流量控制参数和统计
+            struct FlowControl
+            {
+                using ptr = std::shared_ptr<FlowControl>;
+
+                const TopicPolicy policy;           // 订阅者等待队列满时的处理策略
+                const size_t max_queue;             // 订阅者等待队列的上限
+                std::atomic<uint64_t> dropped{0};   // 被丢弃的消息数量
+                std::atomic<int> blocked{0};        // 等待队列已满的订阅者数量，BLOCK策略下大于0时拒绝新的发布
+
+                FlowControl(TopicPolicy p, size_t max)
+                    :policy(p), max_queue(max > 0 ? max : 1)
+                {}
+            };
+
             // 订阅者描述类
             struct Subscriber
             {
+                // 等待发送的消息
+                struct Pending
+                {
+                    Frame frame;
+                    FlowControl::ptr flow;  // 消息所属主题的流量控制，用于统计丢弃的消息
+                };
+
                 std::mutex _mutex;
+                const uint64_t id;                      // 订阅者编号，决定由哪个工作线程向它推送消息
                 BaseConnection::ptr conn;               // 对应的连接
-                std::unordered_set<std::string> topics; // 订阅者订阅的主题名称
+                std::unordered_set<std::string> topics; // 订阅者订阅的主题名称和通配符模式
+
+                // 连接的输出缓冲区超过高水位后，消息先进入有上限的等待队列，连接重新可写时再发送
+                std::mutex _queue_mutex;
+                std::deque<Pending> queue;              // 等待发送的消息，所有主题的消息按推送顺序排队
+                std::unordered_map<FlowControl::ptr, size_t> queued;   // 每个主题在等待队列中的消息数量，队列上限按主题分别计算
+                std::vector<FlowControl::ptr> blocking; // 被当前订阅者阻塞发布的主题
 
                 using ptr = std::shared_ptr<Subscriber>;
 
-                Subscriber(const BaseConnection::ptr& c)
-                    :conn(c)
+                Subscriber(const BaseConnection::ptr& c, uint64_t i)
+                    :id(i), conn(c)
                 {}
 
                 // 订阅主题的时候调用
@@ -37,80 +69,598 @@ namespace util_ns
                     std::unique_lock<std::mutex> lock(_mutex);
                     topics.erase(topic_name);
                 }
+
+                // 获取订阅的主题名称的副本，主题可能在其他I/O线程中被同时删除
+                std::vector<std::string> topicNames()
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    return std::vector<std::string>(topics.begin(), topics.end());
+                }
+
+                // 向订阅者推送一条消息
+                // 连接可写且没有积压时直接发送，否则放入等待队列
+                // 一个主题排队的消息达到它的上限时，按该主题的策略只处理该主题自己的消息，不影响其他主题
+                void push(const Frame& frame, const FlowControl::ptr& flow)
+                {
+                    std::unique_lock<std::mutex> lock(_queue_mutex);
+                    if(queue.empty() && conn->writable())
+                    {
+                        conn->sendRaw(frame);
+                        return;
+                    }
+                    if(queuedCount(flow) >= flow->max_queue)
+                    {
+                        switch(flow->policy)
+                        {
+                            case TopicPolicy::POLICY_DROP_NEWEST:
+                                flow->dropped.fetch_add(1, std::memory_order_relaxed);
+                                return;
+                            case TopicPolicy::POLICY_DISCONNECT:
+                                LOG(WARING, "订阅者消费过慢，断开连接！\n");
+                                flow->dropped.fetch_add(1, std::memory_order_relaxed);
+                                for(auto& pending : queue)
+                                {
+                                    pending.flow->dropped.fetch_add(1, std::memory_order_relaxed);
+                                }
+                                queue.clear();
+                                queued.clear();
+                                conn->forceClose();
+                                return;
+                            case TopicPolicy::POLICY_BLOCK:
+                                // 已经通过发布检查的消息仍然放入队列，之后的发布会被拒绝
+                                if(std::find(blocking.begin(), blocking.end(), flow) == blocking.end())
+                                {
+                                    blocking.push_back(flow);
+                                    flow->blocked.fetch_add(1, std::memory_order_relaxed);
+                                }
+                                break;
+                            default:
+                                // 丢弃该主题最早的一条消息
+                                for(auto it = queue.begin(); it != queue.end(); ++it)
+                                {
+                                    if(it->flow == flow)
+                                    {
+                                        flow->dropped.fetch_add(1, std::memory_order_relaxed);
+                                        queue.erase(it);
+                                        --queued[flow];
+                                        break;
+                                    }
+                                }
+                                break;
+                        }
+                    }
+                    queue.push_back(Pending{frame, flow});
+                    ++queued[flow];
+                }
+
+                // 连接重新变为可写时调用，发送等待队列中的消息
+                void drain()
+                {
+                    std::unique_lock<std::mutex> lock(_queue_mutex);
+                    while(queue.empty() == false && conn->writable())
+                    {
+                        conn->sendRaw(queue.front().frame);
+                        auto it = queued.find(queue.front().flow);
+                        if(it != queued.end() && --it->second == 0)
+                            queued.erase(it);
+                        queue.pop_front();
+                    }
+                    // 主题排队的消息降到上限以下，恢复被阻塞的主题
+                    for(auto it = blocking.begin(); it != blocking.end(); )
+                    {
+                        if(queuedCount(*it) < (*it)->max_queue)
+                        {
+                            (*it)->blocked.fetch_sub(1, std::memory_order_relaxed);
+                            it = blocking.erase(it);
+                        }
+                        else
+                        {
+                            ++it;
+                        }
+                    }
+                }
+
+                // 主题在等待队列中的消息数量，调用者需要持有_queue_mutex
+                size_t queuedCount(const FlowControl::ptr& flow)
+                {
+                    auto it = queued.find(flow);
+                    return it == queued.end() ? 0 : it->second;
+                }
+
+                // 订阅者断开连接时调用，丢弃等待队列并恢复被阻塞的主题
+                void clear()
+                {
+                    std::unique_lock<std::mutex> lock(_queue_mutex);
+                    queue.clear();
+                    queued.clear();
+                    for(auto& flow : blocking)
+                    {
+                        flow->blocked.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                    blocking.clear();
+                }
+            };
+
+            // 通配符订阅的匹配树，推送消息时沿主题名称逐级向下查找，不需要遍历所有的模式
+            // 订阅/取消订阅时增量修改；使用读写锁，推送时并发查找，修改时独占
+            // 每次修改递增版本号，主题据此判断缓存的合并快照是否仍然有效
+            class PatternTrie
+            {
+            private:
+                pthread_rwlock_t _rwlock;
+                TopicTrie<Subscriber::ptr> _trie;
+                std::atomic<size_t> _count{0};          // 模式订阅的数量，为0时推送消息不需要加锁查找
+                std::atomic<uint64_t> _generation{0};   // 修改的版本号
+
+            public:
+                using ptr = std::shared_ptr<PatternTrie>;
+
+                PatternTrie()
+                {
+                    pthread_rwlock_init(&_rwlock, nullptr);
+                }
+
+                ~PatternTrie()
+                {
+                    pthread_rwlock_destroy(&_rwlock);
+                }
+
+                // 添加一个模式订阅
+                void insert(const std::string& pattern, const Subscriber::ptr& subscriber)
+                {
+                    pthread_rwlock_wrlock(&_rwlock);
+                    if(_trie.insert(pattern, subscriber))
+                    {
+                        _count.fetch_add(1, std::memory_order_relaxed);
+                        _generation.fetch_add(1, std::memory_order_release);
+                    }
+                    pthread_rwlock_unlock(&_rwlock);
+                }
+
+                // 删除一个模式订阅
+                void remove(const std::string& pattern, const Subscriber::ptr& subscriber)
+                {
+                    pthread_rwlock_wrlock(&_rwlock);
+                    if(_trie.remove(pattern, subscriber))
+                    {
+                        _count.fetch_sub(1, std::memory_order_relaxed);
+                        _generation.fetch_add(1, std::memory_order_release);
+                    }
+                    pthread_rwlock_unlock(&_rwlock);
+                }
+
+                // 查找与主题名称匹配的所有模式的订阅者，同一订阅者可能出现多次
+                void match(const std::string& topic_name, std::vector<Subscriber::ptr>& out)
+                {
+                    if(empty())
+                        return;
+                    pthread_rwlock_rdlock(&_rwlock);
+                    _trie.match(topic_name, out);
+                    pthread_rwlock_unlock(&_rwlock);
+                }
+
+                bool empty()
+                {
+                    return _count.load(std::memory_order_relaxed) == 0;
+                }
+
+                // 需要在查找之前读取，查找到的结果不会比该版本旧
+                uint64_t generation()
+                {
+                    return _generation.load(std::memory_order_acquire);
+                }
             };
 
             // 主题描述类
-            struct Topic
+            // 订阅者列表采用写时复制：订阅/取消订阅时复制一份新的列表替换旧列表，已经发布出去的快照不受影响
+            // 快照通过atomic_load/atomic_store整体替换，推送消息时不加锁，_mutex只用于串行化订阅/取消订阅
+            struct Topic : public std::enable_shared_from_this<Topic>
             {
-                std::mutex _mutex;
+                // 订阅者按编号分桶，每个桶由固定的工作线程推送，保证同一订阅者收到的消息顺序与发布顺序一致
+                using Snapshot = std::vector<std::vector<Subscriber::ptr>>;
+
+                std::mutex _mutex;                          // 只在修改订阅者列表时使用
                 std::string topic_name;                     // 主题名称
-                std::unordered_set<Subscriber::ptr> subscribers; // 当前主题订阅者
+                std::shared_ptr<const Snapshot> subscribers; // 当前主题订阅者的快照
+                FlowControl::ptr flow;                      // 慢消费者的处理策略和统计
+
+                // 消息保留：最近发布的retention条消息连同偏移量保存在环形队列中，订阅时可以先回放再接收新消息
+                // 开启保留时，分配偏移量、写入队列和投递推送任务在_ring_mutex中完成，保证回放与实时推送之间不重复、不遗漏
+                struct Retained
+                {
+                    uint64_t offset;
+                    FrameCache::ptr frames;
+                };
+                const size_t retention;                     // 保留的消息数量，0表示不保留
+                std::mutex _ring_mutex;
+                std::deque<Retained> ring;                  // 最近发布的消息，按偏移量递增
+                std::atomic<uint64_t> next_offset{0};       // 下一条消息的偏移量
+
+                // 持久化：消息写入日志，组提交落盘后才响应发布者并推送，回放直接读取日志
+                // 落盘回调按偏移量顺序在_ring_mutex中推送，dispatched_offset之前的消息已经推送给了当时的订阅者
+                TopicLog::ptr log;                          // 为空表示不持久化
+                PatternTrie::ptr patterns;                  // 通配符订阅，推送时合并匹配的订阅者
+                // 合并了通配符订阅者的快照缓存，订阅者快照和通配符订阅都没有变化时直接使用
+                struct Merged
+                {
+                    uint64_t generation;
+                    std::shared_ptr<const Snapshot> base;
+                    std::shared_ptr<const Snapshot> merged;
+                };
+                std::shared_ptr<const Merged> merged_cache;
+                uint64_t dispatched_offset = 0;             // 下一条等待推送的消息的偏移量
 
                 using ptr = std::shared_ptr<Topic>;
 
-                Topic(const std::string &name) 
-                    :topic_name(name)
-                {}
+                Topic(const std::string &name, const FlowControl::ptr& fc, size_t buckets = 1, size_t retain = 0,
+                      const TopicLog::ptr& l = TopicLog::ptr()) 
+                    :topic_name(name),
+                    subscribers(std::make_shared<const Snapshot>(buckets > 0 ? buckets : 1)),
+                    flow(fc),
+                    retention(retain),
+                    log(l)
+                {
+                    if(log)
+                    {
+                        next_offset = log->nextOffset();
+                        dispatched_offset = next_offset;
+                    }
+                }
+
+                // 订阅主题，请求中携带了起始偏移量或最近消息数量时，先回放保留的消息
+                void subscribe(const Subscriber::ptr& subscriber, const TopicRequest::ptr& msg)
+                {
+                    if((retention == 0 && !log) || (msg->hasOffset() == false && msg->lastCount() == 0))
+                    {
+                        return appendSubscriber(subscriber);
+                    }
+                    // 持有_ring_mutex期间不会有新消息发布，回放的是加入订阅之前的所有消息，之后的消息由实时推送送达
+                    std::unique_lock<std::mutex> lock(_ring_mutex);
+                    if(log)
+                    {
+                        replayLog(subscriber, msg);
+                        return appendSubscriber(subscriber);
+                    }
+                    uint64_t start = 0;
+                    if(msg->hasOffset())
+                    {
+                        start = msg->offset();
+                    }
+                    else
+                    {
+                        uint64_t last = std::min<uint64_t>(msg->lastCount(), ring.size());
+                        start = next_offset.load(std::memory_order_relaxed) - last;
+                    }
+                    CodecType codec = subscriber->conn->codec();
+                    for(auto& retained : ring)
+                    {
+                        if(retained.offset < start)
+                            continue;
+                        Frame frame = retained.frames->get(codec);
+                        if(frame)
+                            subscriber->push(frame, flow);
+                    }
+                    appendSubscriber(subscriber);
+                }
+
+                // 从日志中回放已经推送过的消息，还没有落盘的消息会在落盘后推送给包括当前订阅者在内的所有订阅者
+                // 日志中保存的是json编码的报文，json订阅者直接从映射的内存拷贝，其他编码方式需要重新编码
+                void replayLog(const Subscriber::ptr& subscriber, const TopicRequest::ptr& msg)
+                {
+                    uint64_t first = log->firstOffset();
+                    uint64_t start = 0;
+                    if(msg->hasOffset())
+                    {
+                        start = std::max(msg->offset(), first);
+                    }
+                    else
+                    {
+                        uint64_t available = dispatched_offset > first ? dispatched_offset - first : 0;
+                        uint64_t last = std::min<uint64_t>(msg->lastCount(), available);
+                        start = dispatched_offset - last;
+                    }
+                    CodecType codec = subscriber->conn->codec();
+                    FlowControl::ptr fc = flow;
+                    log->read(start, dispatched_offset, [&subscriber, codec, fc](uint64_t, const char* data, size_t len)
+                    {
+                        Frame frame;
+                        if(codec == CodecType::CODEC_JSON)
+                            frame = std::make_shared<const std::string>(data, len);
+                        else
+                            frame = transcode(data, len, codec);
+                        if(!frame)
+                        {
+                            LOG(FATAL, "持久化的主题消息解析失败！\n");
+                            return false;
+                        }
+                        subscriber->push(frame, fc);
+                        return true;
+                    });
+                }
+
+                // 把日志中的报文转换成其他编码方式
+                static Frame transcode(const char* data, size_t len, CodecType codec)
+                {
+                    std::string raw(data, len);
+                    BaseMessage::ptr msg;
+                    LVProtocol protocol;
+                    if(protocol.onMessage(std::make_shared<StringBuffer>(&raw), msg) == false)
+                        return Frame();
+                    return FrameFactory::create(msg, codec);
+                }
 
                 // 新增订阅者的时候使用
                 void appendSubscriber(const Subscriber::ptr& subscriber)
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
-                    subscribers.insert(subscriber);
+                    auto snapshot = std::make_shared<Snapshot>(*subscribers);
+                    auto& bucket = (*snapshot)[subscriber->id % snapshot->size()];
+                    if(std::find(bucket.begin(), bucket.end(), subscriber) != bucket.end())
+                        return;
+                    bucket.push_back(subscriber);
+                    std::atomic_store(&subscribers, std::shared_ptr<const Snapshot>(snapshot));
                 }
 
                 // 取消订阅 或 订阅连接者断开 的时候调用
                 void removeSubscriber(const Subscriber::ptr& subscriber)
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
-                    subscribers.erase(subscriber);
+                    auto snapshot = std::make_shared<Snapshot>(*subscribers);
+                    auto& bucket = (*snapshot)[subscriber->id % snapshot->size()];
+                    auto it = std::find(bucket.begin(), bucket.end(), subscriber);
+                    if(it == bucket.end())
+                        return;
+                    bucket.erase(it);
+                    std::atomic_store(&subscribers, std::shared_ptr<const Snapshot>(snapshot));
+                }
+
+                // 获取当前订阅者的快照，不加锁
+                std::shared_ptr<const Snapshot> snapshot()
+                {
+                    return std::atomic_load(&subscribers);
                 }
 
                 // 收到消息发布请求的时候调用
-                void pushMessage(const BaseMessage::ptr& msg)
+                // 为消息分配偏移量后调用ack响应发布者，然后再推送给订阅者；持久化主题写入日志失败时返回false
+                bool pushMessage(const TopicRequest::ptr& msg, const WorkerPool::ptr& workers, 
+                                 const std::function<void(uint64_t)>& ack)
+                {
+                    if(retention == 0 && !log)
+                    {
+                        // 不保留消息时偏移量只用于标识消息，无锁分配
+                        uint64_t offset = next_offset.fetch_add(1, std::memory_order_relaxed);
+                        msg->setOffset(offset);
+                        ack(offset);
+                        dispatch(std::make_shared<FrameCache>(msg), workers);
+                        return true;
+                    }
+                    std::unique_lock<std::mutex> lock(_ring_mutex);
+                    uint64_t offset = next_offset.load(std::memory_order_relaxed);
+                    msg->setOffset(offset);
+                    FrameCache::ptr frames = std::make_shared<FrameCache>(msg);
+                    if(log)
+                    {
+                        Frame frame = frames->get(CodecType::CODEC_JSON);
+                        if(!frame || log->append(offset, frame->data(), frame->size()) == false)
+                        {
+                            LOG(FATAL, "主题 %s 的消息写入日志失败！\n", topic_name.c_str());
+                            return false;
+                        }
+                        next_offset.store(offset + 1, std::memory_order_relaxed);
+                        // 落盘之后才响应发布者并推送，订阅者不会收到崩溃后丢失的消息
+                        auto self = shared_from_this();
+                        log->commit(offset, [self, offset, frames, workers, ack]()
+                        {
+                            std::unique_lock<std::mutex> lock(self->_ring_mutex);
+                            ack(offset);
+                            self->dispatch(frames, workers);
+                            self->dispatched_offset = offset + 1;
+                        });
+                        return true;
+                    }
+                    next_offset.store(offset + 1, std::memory_order_relaxed);
+                    ring.push_back(Retained{offset, frames});
+                    if(ring.size() > retention)
+                    {
+                        ring.pop_front();
+                    }
+                    ack(offset);
+                    dispatch(frames, workers);
+                    return true;
+                }
+
+                // 没有工作线程时在当前线程推送，否则每个桶投递给对应的工作线程并行推送，不等待推送完成
+                void dispatch(const FrameCache::ptr& frames, const WorkerPool::ptr& workers)
+                {
+                    // 消息对所有订阅者都是相同的，每种编码方式只序列化一次，各连接共享编码好的报文
+                    std::shared_ptr<const Snapshot> snap = withPatterns(snapshot());
+                    for(size_t i = 0; i < snap->size(); i++)
+                    {
+                        if((*snap)[i].empty())
+                            continue;
+                        if(workers)
+                        {
+                            FlowControl::ptr fc = flow;
+                            bool ret = workers->post(i, [snap, i, frames, fc]() { deliver((*snap)[i], frames, fc); });
+                            if(ret)
+                                continue;
+                            // 队列已满时退化为当前线程推送，这部分订阅者的消息可能先于队列中更早的消息到达
+                            LOG(WARING, "推送线程任务队列已满，在当前线程推送主题 %s 的消息！\n", topic_name.c_str());
+                        }
+                        deliver((*snap)[i], frames, flow);
+                    }
+                }
+
+                // 合并匹配当前主题的通配符订阅者，同一订阅者只推送一次
+                // 订阅者仍然按编号分桶，无论通过哪种订阅收到消息，都由同一个工作线程推送
+                // 合并结果缓存下来，只有订阅者快照被替换或通配符订阅有修改时才重新查找和复制
+                std::shared_ptr<const Snapshot> withPatterns(const std::shared_ptr<const Snapshot>& snap)
+                {
+                    if(!patterns || patterns->empty())
+                        return snap;
+                    uint64_t generation = patterns->generation();
+                    std::shared_ptr<const Merged> cache = std::atomic_load(&merged_cache);
+                    if(cache && cache->generation == generation && cache->base == snap)
+                        return cache->merged;
+                    std::vector<Subscriber::ptr> matched;
+                    patterns->match(topic_name, matched);
+                    std::shared_ptr<const Snapshot> result = snap;
+                    if(matched.empty() == false)
+                    {
+                        auto merged = std::make_shared<Snapshot>(*snap);
+                        for(auto& subscriber : matched)
+                        {
+                            auto& bucket = (*merged)[subscriber->id % merged->size()];
+                            if(std::find(bucket.begin(), bucket.end(), subscriber) == bucket.end())
+                                bucket.push_back(subscriber);
+                        }
+                        result = merged;
+                    }
+                    std::atomic_store(&merged_cache, std::shared_ptr<const Merged>(
+                                          std::make_shared<Merged>(Merged{generation, snap, result})));
+                    return result;
+                }
+
+                static void deliver(const std::vector<Subscriber::ptr>& subscribers, const FrameCache::ptr& frames, 
+                                    const FlowControl::ptr& flow)
                 {
-                    std::unique_lock<std::mutex> lock(_mutex);
                     for(auto& subscriber : subscribers)
                     {
-                        subscriber->conn->send(msg);
+                        Frame frame = frames->get(subscriber->conn->codec());
+                        if(!frame)
+                        {
+                            LOG(FATAL, "主题消息序列化失败！\n");
+                            return;
+                        }
+                        subscriber->push(frame, flow);
                     }
                 }
             };
 
+            // 批量发布的确认：每条消息分配了偏移量（持久化主题为落盘）后调用done，全部完成后只发送一个响应
+            struct BatchAck
+            {
+                using ptr = std::shared_ptr<BatchAck>;
+
+                BaseConnection::ptr conn;
+                TopicRequest::ptr msg;
+                std::vector<uint64_t> offsets;      // 每个位置只由对应消息的确认写入
+                std::atomic<size_t> remaining;      // 还没有确认的消息数量
+                std::atomic<bool> failed{false};
+
+                BatchAck(const BaseConnection::ptr& c, const TopicRequest::ptr& m, size_t n)
+                    :conn(c), msg(m), offsets(n, 0), remaining(n)
+                {}
+
+                void done(size_t i, uint64_t offset, bool ok)
+                {
+                    if(ok)
+                        offsets[i] = offset;
+                    else
+                        failed.store(true, std::memory_order_relaxed);
+                    if(remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                        return;
+                    auto msg_rsp = MessageFactory::create<TopicResponse>();
+                    msg_rsp->SetMytype(MType::RSP_TOPIC);
+                    msg_rsp->SetId(msg->rid());
+                    msg_rsp->setRCode(failed.load(std::memory_order_relaxed) ? RCode::RCODE_INTERNAL_ERROR : RCode::RCODE_OK);
+                    msg_rsp->setOffsets(offsets);
+                    conn->send(msg_rsp);
+                }
+            };
+
         private:
-            std::mutex _mutex;
-            std::unordered_map<std::string, Topic::ptr> _topics;    // 主题名称 与 主题 的映射
+            // 主题表的修改远少于查询：创建/删除主题时复制一份新表整体替换(RCU)，发布消息时不加锁直接读取当前的表
+            using TopicMap = std::unordered_map<std::string, Topic::ptr>;
+            std::mutex _mutex;                                      // 串行化主题表的修改，以及保护订阅者映射
+            std::shared_ptr<const TopicMap> _topics;                // 主题名称 与 主题 的映射
             std::unordered_map<BaseConnection::ptr, Subscriber::ptr> _subscribers;    // 连接 与 订阅者 的映射
+            uint64_t _subscriber_seq = 0;   // 订阅者编号
+            WorkerPool::ptr _workers;       // 消息推送线程池，为空则在发布者的I/O线程中推送
+            TopicStore::ptr _store;         // 持久化主题的存储，为空则不支持持久化主题
+            PatternTrie::ptr _patterns;     // 所有主题共享的通配符订阅
 
         public:
             using ptr = std::shared_ptr<TopicManager>;
+            // 创建主题时没有指定时，每个订阅者等待队列的上限
+            static const size_t defaultQueueSize = 1024;
+            // 每个主题最多保留的消息数量
+            static const size_t maxRetention = 1 << 20;
             
-            TopicManager()
+            TopicManager(const WorkerPool::ptr& workers = WorkerPool::ptr())
+                :_topics(std::make_shared<const TopicMap>()),
+                _workers(workers),
+                _patterns(std::make_shared<PatternTrie>())
             {}
 
+            // 开启持久化主题，并恢复存储中已有的主题，需要在服务器启动之前调用
+            void enableDurable(const TopicStore::ptr& store)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _store = store;
+                for(auto& it : store->recover())
+                {
+                    const Json::Value& meta = it.first;
+                    // 元数据来自磁盘，可能被损坏或由其他版本写入，与创建主题时一样检查策略的范围
+                    TopicPolicy policy = TopicPolicy::POLICY_DROP_OLDEST;
+                    int value = meta[KEY_TOPIC_POLICY].isInt() ? meta[KEY_TOPIC_POLICY].asInt() : -1;
+                    if(value >= (int)TopicPolicy::POLICY_DROP_OLDEST && value <= (int)TopicPolicy::POLICY_BLOCK)
+                    {
+                        policy = (TopicPolicy)value;
+                    }
+                    else
+                    {
+                        LOG(WARING, "主题 %s 的处理策略无效，使用默认策略\n", meta[KEY_TOPIC_KEY].asString().c_str());
+                    }
+                    size_t queue_size = meta[KEY_TOPIC_QUEUE].isUInt64() ? meta[KEY_TOPIC_QUEUE].asUInt64() : defaultQueueSize;
+                    addTopic(meta[KEY_TOPIC_KEY].asString(), policy, queue_size, 0, it.second);
+                }
+            }
+
+            // 获取主题中因为订阅者消费过慢而被丢弃的消息数量
+            uint64_t dropped(const std::string& topic_name)
+            {
+                Topic::ptr topic = findTopic(topic_name);
+                if(!topic)
+                    return 0;
+                return topic->flow->dropped.load(std::memory_order_relaxed);
+            }
+
             // 针对主题请求响应
             void onTopicRequest(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
             {
                 LOG(DEBUG, "针对主题请求响应\n");
                 TopicOptype topic_optype = msg->optype();
+                // 通配符只能用于订阅和取消订阅
+                if(TopicName::isPattern(msg->topicKey()) && 
+                   ((topic_optype != TopicOptype::TOPIC_SUBSCRIBE && topic_optype != TopicOptype::TOPIC_CANCEL) ||
+                    TopicName::validPattern(msg->topicKey()) == false))
+                {
+                    return errorResponse(conn, msg, RCode::RCODE_INVALID_PARAMS);
+                }
                 bool ret = true;
                 switch (topic_optype)
                 {
                     case TopicOptype::TOPIC_CREATE:
-                        topicCreate(conn, msg);
+                        if(topicCreate(conn, msg) == false)
+                            return errorResponse(conn, msg, RCode::RCODE_INTERNAL_ERROR);
                         break;
                     case TopicOptype::TOPIC_REMOVE:
                         topicRemove(conn, msg);
                         break;
                     case TopicOptype::TOPIC_SUBSCRIBE:
-                        topicSubscribe(conn, msg);
+                        ret = topicSubscribe(conn, msg);
                         break;
                     case TopicOptype::TOPIC_CANCEL:
                         topicCancel(conn, msg);
                         break;
                     case TopicOptype::TOPIC_PUBLISH:
-                        topicPublish(conn, msg);
-                        break;
+                        // 发布请求在推送之前就已经响应
+                        return topicPublish(conn, msg);
+                    case TopicOptype::TOPIC_PUBLISH_BATCH:
+                        return topicPublishBatch(conn, msg);
+                    case TopicOptype::TOPIC_SUBSCRIBE_BATCH:
+                        return topicSubscribeBatch(conn, msg);
                     default:
                         return errorResponse(conn, msg, RCode::RCODE_INVALID_OPTYPE);
                 }
@@ -126,6 +676,7 @@ namespace util_ns
                 // 消息发布者断开连接，不需要任何操作；  消息订阅者断开连接需要删除管理数据
                 // 1. 判断断开连接的是否是订阅者，不是的话则直接返回
                 std::vector<Topic::ptr> topics;
+                std::vector<std::string> patterns;
                 Subscriber::ptr subscriber;
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
@@ -137,10 +688,15 @@ namespace util_ns
                     }
                     subscriber = sub_it->second;
                     // 2. 获取到订阅者退出，受影响的主题对象
-                    for(auto& topic_name : subscriber->topics)
+                    for(auto& topic_name : subscriber->topicNames())
                     {
-                        auto topic_it = _topics.find(topic_name);
-                        if(topic_it == _topics.end())
+                        if(TopicName::isPattern(topic_name))
+                        {
+                            patterns.push_back(topic_name);
+                            continue;
+                        }
+                        auto topic_it = _topics->find(topic_name);
+                        if(topic_it == _topics->end())
                             continue;
                         topics.push_back(topic_it->second);
                     }
@@ -152,15 +708,37 @@ namespace util_ns
                 {
                     topic->removeSubscriber(subscriber);
                 }
+                for(auto& pattern : patterns)
+                {
+                    _patterns->remove(pattern, subscriber);
+                }
+                subscriber->conn->setWritableCallback(std::function<void()>());
+                subscriber->clear();
             }
 
             private:
+                // 在当前的主题表中查找主题，不加锁
+                Topic::ptr findTopic(const std::string& topic_name)
+                {
+                    std::shared_ptr<const TopicMap> topics = std::atomic_load(&_topics);
+                    auto it = topics->find(topic_name);
+                    if(it == topics->end())
+                        return Topic::ptr();
+                    return it->second;
+                }
+
                 // 发回错误响应
                 void errorResponse(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg, RCode rcode)
                 {
+                    // QoS 0的发布请求没有人等待响应，失败时只记录日志
+                    if(msg->noAck())
+                    {
+                        LOG(WARING, "不需要确认的发布请求处理失败：%s\n", errReason(rcode).c_str());
+                        return;
+                    }
                     // 构建响应
                     auto msg_rsp = MessageFactory::create<TopicResponse>();
-                    msg->SetMytype(MType::RSP_TOPIC);
+                    msg_rsp->SetMytype(MType::RSP_TOPIC);
                     msg_rsp->SetId(msg->rid());
                     msg_rsp->setRCode(rcode);
                     conn->send(msg_rsp);
@@ -169,6 +747,8 @@ namespace util_ns
                 // 发回正确响应
                 void topicResponse(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
                 {
+                    if(msg->noAck())
+                        return;
                     // 构建响应
                     auto msg_rsp = MessageFactory::create<TopicResponse>();
                     msg_rsp->SetMytype(MType::RSP_TOPIC);
@@ -177,14 +757,53 @@ namespace util_ns
                     conn->send(msg_rsp);
                 }
 
-                // 请求新建一个主题
-                void topicCreate(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
+                // 请求新建一个主题，持久化主题创建日志失败时返回false
+                bool topicCreate(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
                 {
                     std::unique_lock<std::mutex> lock(_mutex);
                     // 构造一个主题对象，添加映射关系的管理
                     std::string topic_name = msg->topicKey();
-                    auto topic = std::make_shared<Topic>(topic_name);
-                    _topics.insert(std::make_pair(topic_name, topic));
+                    if(_topics->count(topic_name) > 0)
+                        return true;
+                    TopicPolicy policy = msg->policy();
+                    if(policy < TopicPolicy::POLICY_DROP_OLDEST || policy > TopicPolicy::POLICY_BLOCK)
+                    {
+                        policy = TopicPolicy::POLICY_DROP_OLDEST;
+                    }
+                    size_t queue_size = msg->queueSize() > 0 ? msg->queueSize() : defaultQueueSize;
+                    size_t retention = msg->retention() > maxRetention ? maxRetention : msg->retention();
+                    TopicLog::ptr log;
+                    if(msg->durable())
+                    {
+                        if(!_store)
+                        {
+                            LOG(WARING, "服务器没有开启持久化，无法创建持久化主题 %s！\n", topic_name.c_str());
+                            return false;
+                        }
+                        // 持久化主题的回放直接读取日志，不再在内存中保留消息
+                        Json::Value meta;
+                        meta[KEY_TOPIC_KEY] = topic_name;
+                        meta[KEY_TOPIC_POLICY] = (int)policy;
+                        meta[KEY_TOPIC_QUEUE] = (Json::UInt64)queue_size;
+                        log = _store->create(topic_name, meta);
+                        if(!log)
+                            return false;
+                        retention = 0;
+                    }
+                    addTopic(topic_name, policy, queue_size, retention, log);
+                    return true;
+                }
+
+                // 构造主题对象并加入主题表，调用者需要持有_mutex
+                void addTopic(const std::string& topic_name, TopicPolicy policy, size_t queue_size, size_t retention,
+                              const TopicLog::ptr& log)
+                {
+                    auto flow = std::make_shared<FlowControl>(policy, queue_size);
+                    auto topic = std::make_shared<Topic>(topic_name, flow, _workers ? _workers->size() : 1, retention, log);
+                    topic->patterns = _patterns;
+                    auto topics = std::make_shared<TopicMap>(*_topics);
+                    (*topics)[topic_name] = topic;
+                    std::atomic_store(&_topics, std::shared_ptr<const TopicMap>(topics));
                 }
 
                 // 删除一个主题
@@ -193,56 +812,87 @@ namespace util_ns
                     // 1. 查看当前主题，有哪些订阅者，然后从订阅者中将主题信息删除掉
                     // 2. 删除主题的数据 -- 主题名称与主题对象的映射关系
                     std::string topic_name = msg->topicKey();
-                    std::unordered_set<Subscriber::ptr> subscribers;
+                    std::shared_ptr<const Topic::Snapshot> subscribers;
+                    Topic::ptr topic;
                     {
                         std::unique_lock<std::mutex> lock(_mutex);
                         // 在删除主题之前，先找出会受到影响的订阅者
-                        auto it = _topics.find(topic_name);
-                        if(it == _topics.end())
+                        auto it = _topics->find(topic_name);
+                        if(it == _topics->end())
                         {
                             return;
                         }
-                        subscribers = it->second->subscribers;
-                        _topics.erase(topic_name);
+                        topic = it->second;
+                        subscribers = topic->snapshot();
+                        auto topics = std::make_shared<TopicMap>(*_topics);
+                        topics->erase(topic_name);
+                        std::atomic_store(&_topics, std::shared_ptr<const TopicMap>(topics));
                     }
                     // 对应的订阅者删除主题
-                    for(auto& subscriber : subscribers)
+                    for(auto& bucket : *subscribers)
                     {
-                        subscriber->removeTopic(topic_name);
+                        for(auto& subscriber : bucket)
+                        {
+                            subscriber->removeTopic(topic_name);
+                        }
+                    }
+                    if(topic->log)
+                    {
+                        _store->remove(topic_name);
                     }
                 }
 
                 // 主题订阅
                 bool topicSubscribe(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
                 {
-                    // 1. 先找出主题对象，以及订阅者对象
-                    // 如果没有找到主题--就要报错；  但是如果没有找到订阅者对象，说明是第一次订阅，那就要构造一个订阅者
+                    // 1. 先找出主题对象，没有找到主题--就要报错
+                    // 通配符订阅不对应具体的主题，匹配的主题可以在订阅之后才创建
                     Topic::ptr topic;
-                    Subscriber::ptr subscriber;
+                    if(TopicName::isPattern(msg->topicKey()) == false)
                     {
-                        std::unique_lock<std::mutex> lock(_mutex);
-                        auto topic_it = _topics.find(msg->topicKey());
-                        if(topic_it == _topics.end())
+                        topic = findTopic(msg->topicKey());
+                        if(!topic)
                         {
                             return false;
                         }
-                        topic = topic_it->second;
-                        auto sub_it = _subscribers.find(conn);
-                        if(sub_it != _subscribers.end())
-                        {
-                            subscriber = sub_it->second;
-                        }
-                        else
-                        {
-                            subscriber = std::make_shared<Subscriber>(conn);
-                            _subscribers.insert(std::make_pair(conn, subscriber));
-                        }
                     }
                     //2. 在主题对象中，新增一个订阅者对象关联的连接；  在订阅者对象中新增一个订阅的主题
-                    topic->appendSubscriber(subscriber);
-                    subscriber->appendTopic(topic->topic_name);
+                    subscribeTopic(findSubscriber(conn), topic, msg);
                     return true;
                 }
+
+                // 查找连接对应的订阅者，如果没有找到，说明是第一次订阅，那就要构造一个订阅者
+                Subscriber::ptr findSubscriber(const BaseConnection::ptr& conn)
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    auto sub_it = _subscribers.find(conn);
+                    if(sub_it != _subscribers.end())
+                    {
+                        return sub_it->second;
+                    }
+                    auto subscriber = std::make_shared<Subscriber>(conn, _subscriber_seq++);
+                    _subscribers.insert(std::make_pair(conn, subscriber));
+                    // 连接积压的数据发送完后，继续发送等待队列中的消息
+                    std::weak_ptr<Subscriber> weak_sub = subscriber;
+                    conn->setWritableCallback([weak_sub]()
+                    {
+                        auto sub = weak_sub.lock();
+                        if(sub)
+                            sub->drain();
+                    });
+                    return subscriber;
+                }
+
+                // 订阅已经找到的主题，topic为空表示通配符订阅，不会失败
+                // 通配符订阅只接收之后发布的消息，不回放
+                void subscribeTopic(const Subscriber::ptr& subscriber, const Topic::ptr& topic, const TopicRequest::ptr& msg)
+                {
+                    if(topic)
+                        topic->subscribe(subscriber, msg);
+                    else
+                        _patterns->insert(msg->topicKey(), subscriber);
+                    subscriber->appendTopic(msg->topicKey());
+                }
                 
                 // 取消订阅
                 void topicCancel(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
@@ -252,8 +902,8 @@ namespace util_ns
                     Subscriber::ptr subscriber;
                     {
                         std::unique_lock<std::mutex> lock(_mutex);
-                        auto topic_it = _topics.find(msg->topicKey());
-                        if(topic_it != _topics.end())
+                        auto topic_it = _topics->find(msg->topicKey());
+                        if(topic_it != _topics->end())
                         {
                             topic = topic_it->second;
                         }
@@ -267,23 +917,137 @@ namespace util_ns
                     // 2. 从主题对象中删除当前的订阅者连接； 从订阅者信息中删除所订阅的主题名称
                     if(subscriber) subscriber->removeTopic(msg->topicKey());
                     if(topic && subscriber) topic->removeSubscriber(subscriber);
+                    if(subscriber && TopicName::isPattern(msg->topicKey())) _patterns->remove(msg->topicKey(), subscriber);
                 }
 
-                bool topicPublish(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
+                // 消息发布：先响应发布者，再推送给订阅者，发布者不需要等待推送完成
+                void topicPublish(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
                 {
-                    // 1. 先找出主题对象
-                    Topic::ptr topic;
+                    // 1. 先找出主题对象，不加锁
+                    Topic::ptr topic = findTopic(msg->topicKey());
+                    if(!topic)
                     {
-                        std::unique_lock<std::mutex> lock(_mutex);
-                        auto topic_it = _topics.find(msg->topicKey());
-                        if(topic_it == _topics.end())
+                        return errorResponse(conn, msg, RCode::RCODE_NOT_FOUND_TOPIC);
+                    }
+                    // BLOCK策略下有订阅者积压满了，拒绝发布，发布者稍后重试
+                    if(publishBlocked(topic))
+                    {
+                        return errorResponse(conn, msg, RCode::RCODE_SERVER_BUSY);
+                    }
+                    // 2. 响应中携带分配给消息的偏移量，然后推送给订阅者；持久化主题在落盘后才响应，回调中需要持有连接和请求
+                    // QoS 0的发布不发送响应，省去一半的报文
+                    if(msg->noAck())
+                    {
+                        if(topic->pushMessage(msg, _workers, [](uint64_t) {}) == false)
+                            errorResponse(conn, msg, RCode::RCODE_INTERNAL_ERROR);
+                        return;
+                    }
+                    bool ret = topic->pushMessage(msg, _workers, [conn, msg](uint64_t offset)
+                    {
+                        auto msg_rsp = MessageFactory::create<TopicResponse>();
+                        msg_rsp->SetMytype(MType::RSP_TOPIC);
+                        msg_rsp->SetId(msg->rid());
+                        msg_rsp->setRCode(RCode::RCODE_OK);
+                        msg_rsp->setOffset(offset);
+                        conn->send(msg_rsp);
+                    });
+                    if(ret == false)
+                    {
+                        return errorResponse(conn, msg, RCode::RCODE_INTERNAL_ERROR);
+                    }
+                }
+
+                // 主题是否因为BLOCK策略拒绝发布
+                static bool publishBlocked(const Topic::ptr& topic)
+                {
+                    return topic->flow->policy == TopicPolicy::POLICY_BLOCK && 
+                           topic->flow->blocked.load(std::memory_order_relaxed) > 0;
+                }
+
+                // 批量发布：一个请求中包含一个或多个主题的多条消息，所有消息都分配偏移量后用一个响应确认
+                // 先检查所有主题，任何一个主题不存在或者拒绝发布时整批拒绝，不发布其中的任何消息
+                void topicPublishBatch(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
+                {
+                    size_t n = msg->batchSize();
+                    std::vector<TopicRequest::ptr> items;
+                    std::vector<Topic::ptr> topics;
+                    items.reserve(n);
+                    topics.reserve(n);
+                    for(size_t i = 0; i < n; i++)
+                    {
+                        TopicRequest::ptr item = msg->batchItem(i);
+                        if(TopicName::isPattern(item->topicKey()))
+                            return errorResponse(conn, msg, RCode::RCODE_INVALID_PARAMS);
+                        Topic::ptr topic = findTopic(item->topicKey());
+                        if(!topic)
+                            return errorResponse(conn, msg, RCode::RCODE_NOT_FOUND_TOPIC);
+                        if(publishBlocked(topic))
+                            return errorResponse(conn, msg, RCode::RCODE_SERVER_BUSY);
+                        items.push_back(item);
+                        topics.push_back(topic);
+                    }
+                    if(n == 0)
+                        return topicResponse(conn, msg);
+                    // 同一主题的消息按在批量请求中的顺序发布
+                    if(msg->noAck())
+                    {
+                        for(size_t i = 0; i < n; i++)
                         {
-                            return false;
+                            if(topics[i]->pushMessage(items[i], _workers, [](uint64_t) {}) == false)
+                                return errorResponse(conn, msg, RCode::RCODE_INTERNAL_ERROR);
                         }
-                        topic = topic_it->second;
+                        return;
                     }
-                    topic->pushMessage(msg);
-                    return true;
+                    auto batch = std::make_shared<BatchAck>(conn, msg, n);
+                    for(size_t i = 0; i < n; i++)
+                    {
+                        bool ret = topics[i]->pushMessage(items[i], _workers, [batch, i](uint64_t offset)
+                        {
+                            batch->done(i, offset, true);
+                        });
+                        if(ret == false)
+                            batch->done(i, 0, false);
+                    }
+                }
+
+                // 批量订阅：先检查所有主题并取出主题对象，全部存在时才使用取出的主题对象逐个订阅，之后只发送一个响应
+                // 订阅已经找到的主题不会失败，因此要么全部订阅，要么一个也不订阅
+                void topicSubscribeBatch(const BaseConnection::ptr& conn, const TopicRequest::ptr& msg)
+                {
+                    size_t n = msg->batchSize();
+                    std::vector<TopicRequest::ptr> items;
+                    std::vector<Topic::ptr> topics;
+                    items.reserve(n);
+                    topics.reserve(n);
+                    for(size_t i = 0; i < n; i++)
+                    {
+                        TopicRequest::ptr item = msg->batchItem(i);
+                        std::string key = item->topicKey();
+                        Topic::ptr topic;
+                        if(TopicName::isPattern(key))
+                        {
+                            if(TopicName::validPattern(key) == false)
+                                return errorResponse(conn, msg, RCode::RCODE_INVALID_PARAMS);
+                        }
+                        else
+                        {
+                            topic = findTopic(key);
+                            if(!topic)
+                                return errorResponse(conn, msg, RCode::RCODE_NOT_FOUND_TOPIC);
+                        }
+                        items.push_back(item);
+                        topics.push_back(topic);
+                    }
+                    if(n > 0)
+                    {
+                        // 检查之后主题可能被并发删除，此时订阅的是已经删除的主题对象，与先订阅后删除的效果相同
+                        Subscriber::ptr subscriber = findSubscriber(conn);
+                        for(size_t i = 0; i < n; i++)
+                        {
+                            subscribeTopic(subscriber, topics[i], items[i]);
+                        }
+                    }
+                    topicResponse(conn, msg);
                 }
         };
 
@@ -0,0 +1,699 @@
+#pragma once
+#include "../common/net.hpp"
+#include "../common/message.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <deque>
+
+namespace util_ns
+{
+    namespace server
+    {
+        // 持久化主题的存储参数
+        struct LogOptions
+        {
+            size_t segment_bytes = 64 * 1024 * 1024;             // 每个段文件预分配的大小
+            size_t retention_bytes = 1024ull * 1024 * 1024;      // 每个主题保留的数据总量，超过后删除最早的段，0表示不限制
+            int64_t retention_ms = 7 * 24 * 3600 * 1000ll;       // 消息的保留时间，0表示不限制
+            int flush_interval_ms = 10;                          // 组提交的最长间隔
+            size_t flush_bytes = 1024 * 1024;                    // 未落盘的数据达到该大小时立即提交
+        };
+
+        // 日志段：一个预分配并映射到内存中的文件，记录依次追加在文件中
+        // 记录格式：|--len 4B--|--crc 4B--|--offset 8B--|--timestamp 8B--|--frame--|，frame为编码好的完整报文，整数均为网络字节序
+        // crc是crc字段之后所有数据的CRC32
+        // 写入记录时最后写len字段，预分配的文件内容为0，崩溃后第一个len为0或crc不匹配的位置就是有效数据的末尾
+        // 一个段中的偏移量是连续的，索引直接按 偏移量-base 保存记录在文件中的位置
+        class LogSegment
+        {
+        public:
+            using ptr = std::shared_ptr<LogSegment>;
+            static const size_t headerLength = 24;
+
+        private:
+            const uint64_t _base;               // 第一条记录的偏移量
+            const std::string _path;
+            int _fd;
+            char *_addr;                        // 文件映射的起始地址
+            size_t _capacity;                   // 文件大小，段封存后等于已写入的大小
+            std::atomic<size_t> _size;          // 已写入的字节数
+            size_t _synced;                     // 已经落盘的字节数，只由组提交线程修改
+            int64_t _last_ts;                   // 最后一条记录的写入时间(ms)
+            std::vector<uint32_t> _index;       // 偏移量 与 记录位置 的映射
+
+        public:
+            LogSegment(const std::string &path, uint64_t base)
+                : _base(base), _path(path), _fd(-1), _addr(nullptr), _capacity(0), _size(0), _synced(0), _last_ts(0)
+            {}
+
+            ~LogSegment()
+            {
+                if (_addr != nullptr)
+                    munmap(_addr, _capacity);
+                if (_fd >= 0)
+                    close(_fd);
+            }
+
+            // 创建一个新的段文件，预分配capacity字节
+            static ptr create(const std::string &path, uint64_t base, size_t capacity)
+            {
+                auto seg = std::make_shared<LogSegment>(path, base);
+                seg->_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (seg->_fd < 0)
+                {
+                    LOG(FATAL, "创建日志段 %s 失败：%s\n", path.c_str(), strerror(errno));
+                    return ptr();
+                }
+                if (posix_fallocate(seg->_fd, 0, capacity) != 0)
+                {
+                    LOG(FATAL, "日志段 %s 预分配空间失败！\n", path.c_str());
+                    ::unlink(path.c_str());
+                    return ptr();
+                }
+                seg->_capacity = capacity;
+                if (seg->map() == false)
+                {
+                    ::unlink(path.c_str());
+                    return ptr();
+                }
+                return seg;
+            }
+
+            // 加载已有的段文件，扫描出所有完整的记录并重建索引
+            static ptr load(const std::string &path, uint64_t base)
+            {
+                auto seg = std::make_shared<LogSegment>(path, base);
+                seg->_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+                if (seg->_fd < 0)
+                {
+                    LOG(FATAL, "打开日志段 %s 失败：%s\n", path.c_str(), strerror(errno));
+                    return ptr();
+                }
+                struct stat st;
+                if (fstat(seg->_fd, &st) != 0 || st.st_size <= 0)
+                    return ptr();
+                seg->_capacity = st.st_size;
+                if (seg->map() == false)
+                    return ptr();
+                seg->scan();
+                return seg;
+            }
+
+            uint64_t base()
+            {
+                return _base;
+            }
+
+            // 下一条记录的偏移量
+            uint64_t nextOffset()
+            {
+                return _base + _index.size();
+            }
+
+            size_t size()
+            {
+                return _size.load(std::memory_order_acquire);
+            }
+
+            int64_t lastTimestamp()
+            {
+                return _last_ts;
+            }
+
+            // 追加一条记录，空间不足时返回false
+            bool append(uint64_t offset, int64_t ts, const char *frame, size_t len)
+            {
+                size_t pos = _size.load(std::memory_order_relaxed);
+                if (pos + headerLength + len > _capacity)
+                    return false;
+                char *rec = _addr + pos;
+                uint64_t be_offset = htobe64(offset);
+                uint64_t be_ts = htobe64((uint64_t)ts);
+                memcpy(rec + 8, &be_offset, 8);
+                memcpy(rec + 16, &be_ts, 8);
+                memcpy(rec + headerLength, frame, len);
+                uint32_t be_crc = htonl(Crc32::compute(rec + 8, headerLength - 8 + len));
+                memcpy(rec + 4, &be_crc, 4);
+                int32_t be_len = htonl((int32_t)len);
+                memcpy(rec, &be_len, 4);
+                _index.push_back((uint32_t)pos);
+                _last_ts = ts;
+                _size.store(pos + headerLength + len, std::memory_order_release);
+                return true;
+            }
+
+            // 读取指定偏移量的记录，返回报文的起始地址和长度
+            bool read(uint64_t offset, const char *&frame, size_t &len)
+            {
+                if (offset < _base || offset >= nextOffset())
+                    return false;
+                const char *rec = _addr + _index[offset - _base];
+                int32_t be_len = 0;
+                memcpy(&be_len, rec, 4);
+                len = (size_t)ntohl(be_len);
+                frame = rec + headerLength;
+                return true;
+            }
+
+            // 把upto之前的数据刷到磁盘上，失败时返回false，已落盘的位置不变，下次重新落盘
+            bool sync(size_t upto)
+            {
+                if (upto <= _synced)
+                    return true;
+                static const size_t page = sysconf(_SC_PAGESIZE);
+                size_t begin = _synced / page * page;
+                if (msync(_addr + begin, upto - begin, MS_SYNC) != 0)
+                {
+                    LOG(FATAL, "日志段 %s 落盘失败：%s\n", _path.c_str(), strerror(errno));
+                    return false;
+                }
+                _synced = upto;
+                return true;
+            }
+
+            // 段写满后封存，截掉预分配但没有使用的空间，映射保留给回放使用
+            void seal()
+            {
+                if (ftruncate(_fd, size()) != 0)
+                {
+                    LOG(WARING, "日志段 %s 截断失败：%s\n", _path.c_str(), strerror(errno));
+                }
+            }
+
+            // 删除段文件，已经映射的内存在对象析构时释放
+            void remove()
+            {
+                ::unlink(_path.c_str());
+            }
+
+        private:
+            bool map()
+            {
+                void *addr = mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+                if (addr == MAP_FAILED)
+                {
+                    LOG(FATAL, "映射日志段 %s 失败：%s\n", _path.c_str(), strerror(errno));
+                    return false;
+                }
+                _addr = (char *)addr;
+                return true;
+            }
+
+            void scan()
+            {
+                size_t pos = 0;
+                while (pos + headerLength <= _capacity)
+                {
+                    const char *rec = _addr + pos;
+                    int32_t be_len = 0;
+                    uint64_t be_offset = 0, be_ts = 0;
+                    memcpy(&be_len, rec, 4);
+                    memcpy(&be_offset, rec + 8, 8);
+                    memcpy(&be_ts, rec + 16, 8);
+                    size_t len = (size_t)(uint32_t)ntohl(be_len);
+                    if (len < 4 || pos + headerLength + len > _capacity || be64toh(be_offset) != nextOffset())
+                        break;
+                    // 报文自身的长度字段必须与记录长度一致，否则是没有写完的记录
+                    int32_t be_frame_len = 0;
+                    memcpy(&be_frame_len, rec + headerLength, 4);
+                    if ((size_t)(uint32_t)ntohl(be_frame_len) != len - 4)
+                        break;
+                    // 报文内容写了一部分时长度都是对的，用校验和判断
+                    uint32_t be_crc = 0;
+                    memcpy(&be_crc, rec + 4, 4);
+                    if (ntohl(be_crc) != Crc32::compute(rec + 8, headerLength - 8 + len))
+                    {
+                        LOG(WARING, "日志段 %s 在位置 %zu 的记录校验失败，丢弃之后的数据\n", _path.c_str(), pos);
+                        break;
+                    }
+                    _index.push_back((uint32_t)pos);
+                    _last_ts = (int64_t)be64toh(be_ts);
+                    pos += headerLength + len;
+                }
+                _size.store(pos, std::memory_order_release);
+                _synced = pos;
+            }
+        };
+
+        // 一个持久化主题的消息日志，由多个日志段组成
+        // 写入与回放由主题串行调用；组提交线程周期性地把新写入的数据落盘，落盘后再执行等待的回调
+        class TopicLog
+        {
+        public:
+            using ptr = std::shared_ptr<TopicLog>;
+            using CommitCallback = std::function<void()>;
+            // 读取记录的回调，返回false时停止读取
+            using ReadCallback = std::function<bool(uint64_t offset, const char *frame, size_t len)>;
+
+        private:
+            const std::string _dir;
+            const LogOptions _options;
+            std::mutex _mutex;                          // 保护段列表和等待落盘的回调
+            std::vector<LogSegment::ptr> _segments;     // 按偏移量递增
+            LogSegment::ptr _active;                    // 当前写入的段，为空时下次写入创建新段
+            uint64_t _next_offset;                      // 下一条消息的偏移量
+            uint64_t _durable_offset;                   // 小于该偏移量的消息都已经落盘
+            size_t _dirty;                              // 还没有落盘的字节数
+            std::deque<std::pair<uint64_t, CommitCallback>> _waiters; // 等待落盘的回调，按偏移量递增
+            std::function<void()> _cb_dirty;            // 未落盘的数据过多时调用，通知组提交线程
+
+        public:
+            TopicLog(const std::string &dir, const LogOptions &options)
+                : _dir(dir), _options(options), _next_offset(0), _durable_offset(0), _dirty(0)
+            {}
+
+            // 打开主题目录下的日志，恢复已有的段，之后的消息写入新的段
+            static ptr open(const std::string &dir, const LogOptions &options, const std::function<void()> &cb_dirty)
+            {
+                auto log = std::make_shared<TopicLog>(dir, options);
+                log->_cb_dirty = cb_dirty;
+                std::vector<uint64_t> bases;
+                DIR *dp = opendir(dir.c_str());
+                if (dp == nullptr)
+                {
+                    LOG(FATAL, "打开主题目录 %s 失败：%s\n", dir.c_str(), strerror(errno));
+                    return ptr();
+                }
+                struct dirent *entry;
+                while ((entry = readdir(dp)) != nullptr)
+                {
+                    unsigned long long base = 0;
+                    char suffix[8] = {0};
+                    if (sscanf(entry->d_name, "%20llu.%4s", &base, suffix) == 2 && strcmp(suffix, "log") == 0)
+                        bases.push_back(base);
+                }
+                closedir(dp);
+                std::sort(bases.begin(), bases.end());
+                for (uint64_t base : bases)
+                {
+                    auto seg = LogSegment::load(log->segmentPath(base), base);
+                    if (!seg)
+                        continue;
+                    // 崩溃前没有写完的段直接封存，不再向其中追加
+                    seg->seal();
+                    if (seg->nextOffset() == base)
+                    {
+                        seg->remove();
+                        continue;
+                    }
+                    log->_segments.push_back(seg);
+                    log->_next_offset = seg->nextOffset();
+                }
+                log->_durable_offset = log->_next_offset;
+                return log;
+            }
+
+            uint64_t nextOffset()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                return _next_offset;
+            }
+
+            // 最早的可以回放的偏移量
+            uint64_t firstOffset()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                return _segments.empty() ? _next_offset : _segments.front()->base();
+            }
+
+            // 追加一条消息，offset必须不小于nextOffset()
+            bool append(uint64_t offset, const char *frame, size_t len)
+            {
+                bool notify = false;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    int64_t now = nowMs();
+                    // 偏移量不连续时（之前的写入失败）也需要新的段，保证段内偏移量连续
+                    if (!_active || offset != _next_offset || _active->append(offset, now, frame, len) == false)
+                    {
+                        if (roll(offset, len) == false)
+                            return false;
+                        _active->append(offset, now, frame, len);
+                    }
+                    _next_offset = offset + 1;
+                    _dirty += LogSegment::headerLength + len;
+                    notify = _dirty >= _options.flush_bytes;
+                }
+                if (notify && _cb_dirty)
+                    _cb_dirty();
+                return true;
+            }
+
+            // 偏移量为offset的消息落盘后在组提交线程中调用cb，回调按偏移量顺序执行
+            // 即使消息已经落盘也不在调用者的线程中执行，调用者可以持有回调中需要的锁
+            void commit(uint64_t offset, const CommitCallback &cb)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _waiters.push_back(std::make_pair(offset, cb));
+            }
+
+            // 组提交：把所有新写入的数据一次性落盘，然后按顺序执行已经落盘的消息的回调
+            // 落盘失败时不推进已落盘的偏移量，也不执行回调，由组提交线程下一轮重试
+            bool sync()
+            {
+                std::vector<std::pair<LogSegment::ptr, size_t>> pending;
+                uint64_t target = 0;
+                size_t dirty = 0;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    if (_dirty == 0 && _waiters.empty())
+                        return true;
+                    for (auto &seg : _segments)
+                    {
+                        pending.push_back(std::make_pair(seg, seg->size()));
+                    }
+                    target = _next_offset;
+                    dirty = _dirty;
+                }
+                // 落盘时不持有锁，不阻塞新消息的写入
+                for (auto &it : pending)
+                {
+                    if (it.first->sync(it.second) == false)
+                        return false;
+                }
+                std::vector<CommitCallback> done;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _durable_offset = target;
+                    _dirty -= dirty;
+                    while (_waiters.empty() == false && _waiters.front().first < _durable_offset)
+                    {
+                        done.push_back(std::move(_waiters.front().second));
+                        _waiters.pop_front();
+                    }
+                }
+                for (auto &cb : done)
+                {
+                    cb();
+                }
+                return true;
+            }
+
+            // 从start开始依次读取end之前的消息，报文直接指向映射的内存，回调返回之前有效
+            void read(uint64_t start, uint64_t end, const ReadCallback &cb)
+            {
+                std::vector<LogSegment::ptr> segments;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    segments = _segments;
+                }
+                for (auto &seg : segments)
+                {
+                    if (seg->nextOffset() <= start)
+                        continue;
+                    for (uint64_t offset = std::max(start, seg->base()); offset < end && offset < seg->nextOffset(); offset++)
+                    {
+                        const char *frame = nullptr;
+                        size_t len = 0;
+                        if (seg->read(offset, frame, len) == false)
+                            break;
+                        if (cb(offset, frame, len) == false)
+                            return;
+                    }
+                }
+            }
+
+            // 按大小和时间删除过期的段，当前写入的段不会被删除
+            void expire()
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                size_t total = 0;
+                for (auto &seg : _segments)
+                {
+                    total += seg->size();
+                }
+                int64_t now = nowMs();
+                while (_segments.size() > 1 && _segments.front() != _active)
+                {
+                    auto &seg = _segments.front();
+                    bool too_big = _options.retention_bytes > 0 && total > _options.retention_bytes;
+                    bool too_old = _options.retention_ms > 0 && now - seg->lastTimestamp() > _options.retention_ms;
+                    if (too_big == false && too_old == false)
+                        break;
+                    LOG(INFO, "删除过期的日志段 %s\n", segmentPath(seg->base()).c_str());
+                    total -= seg->size();
+                    seg->remove();
+                    _segments.erase(_segments.begin());
+                }
+            }
+
+            // 删除主题的所有日志，等待落盘的回调直接执行
+            void destroy()
+            {
+                std::deque<std::pair<uint64_t, CommitCallback>> waiters;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    for (auto &seg : _segments)
+                    {
+                        seg->remove();
+                    }
+                    _segments.clear();
+                    _active.reset();
+                    waiters.swap(_waiters);
+                }
+                for (auto &it : waiters)
+                {
+                    it.second();
+                }
+                ::rmdir(_dir.c_str());
+            }
+
+        private:
+            // 封存当前段，创建以offset为起始偏移量的新段
+            bool roll(uint64_t offset, size_t len)
+            {
+                if (_active)
+                {
+                    _active->seal();
+                    _active.reset();
+                }
+                size_t capacity = std::max(_options.segment_bytes, LogSegment::headerLength + len);
+                auto seg = LogSegment::create(segmentPath(offset), offset, capacity);
+                if (!seg)
+                    return false;
+                _segments.push_back(seg);
+                _active = seg;
+                return true;
+            }
+
+            std::string segmentPath(uint64_t base)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "%020llu.log", (unsigned long long)base);
+                return _dir + "/" + name;
+            }
+
+            static int64_t nowMs()
+            {
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+        };
+
+        // 管理所有持久化主题的日志
+        // 每个主题一个目录，目录中保存主题的配置(meta.json)和日志段；后台线程负责组提交和过期清理
+        class TopicStore
+        {
+        public:
+            using ptr = std::shared_ptr<TopicStore>;
+
+        private:
+            const int expireIntervalMs = 1000;      // 过期清理的间隔
+            const std::string _dir;
+            const LogOptions _options;
+            std::mutex _mutex;
+            std::condition_variable _cond;
+            std::unordered_map<std::string, TopicLog::ptr> _logs; // 主题名称 与 日志 的映射
+            bool _running;
+            bool _notified;
+            std::thread _flusher;
+
+        public:
+            TopicStore(const std::string &dir, const LogOptions &options = LogOptions())
+                : _dir(dir), _options(options), _running(true), _notified(false)
+            {
+                if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+                {
+                    LOG(FATAL, "创建数据目录 %s 失败：%s\n", dir.c_str(), strerror(errno));
+                }
+                _flusher = std::thread(&TopicStore::flushThread, this);
+            }
+
+            ~TopicStore()
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _running = false;
+                }
+                _cond.notify_all();
+                if (_flusher.joinable())
+                    _flusher.join();
+            }
+
+            // 为新主题创建日志，meta为主题的配置，重启恢复时使用
+            TopicLog::ptr create(const std::string &topic_name, const Json::Value &meta)
+            {
+                std::string dir = topicDir(topic_name);
+                if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+                {
+                    LOG(FATAL, "创建主题目录 %s 失败：%s\n", dir.c_str(), strerror(errno));
+                    return TopicLog::ptr();
+                }
+                if (writeMeta(dir, meta) == false)
+                    return TopicLog::ptr();
+                return openLog(topic_name, dir);
+            }
+
+            // 删除主题的日志
+            void remove(const std::string &topic_name)
+            {
+                TopicLog::ptr log;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    auto it = _logs.find(topic_name);
+                    if (it == _logs.end())
+                        return;
+                    log = it->second;
+                    _logs.erase(it);
+                }
+                std::string dir = topicDir(topic_name);
+                ::unlink((dir + "/meta.json").c_str());
+                log->destroy();
+            }
+
+            // 启动时恢复数据目录中的所有主题，返回每个主题的配置和日志
+            std::vector<std::pair<Json::Value, TopicLog::ptr>> recover()
+            {
+                std::vector<std::pair<Json::Value, TopicLog::ptr>> topics;
+                DIR *dp = opendir(_dir.c_str());
+                if (dp == nullptr)
+                    return topics;
+                struct dirent *entry;
+                std::vector<std::string> dirs;
+                while ((entry = readdir(dp)) != nullptr)
+                {
+                    if (entry->d_name[0] != '.')
+                        dirs.push_back(_dir + "/" + entry->d_name);
+                }
+                closedir(dp);
+                for (auto &dir : dirs)
+                {
+                    Json::Value meta;
+                    if (readMeta(dir, meta) == false || meta[KEY_TOPIC_KEY].isString() == false)
+                        continue;
+                    auto log = openLog(meta[KEY_TOPIC_KEY].asString(), dir);
+                    if (!log)
+                        continue;
+                    LOG(INFO, "恢复持久化主题 %s，下一条消息的偏移量为 %llu\n", meta[KEY_TOPIC_KEY].asString().c_str(),
+                        (unsigned long long)log->nextOffset());
+                    topics.push_back(std::make_pair(meta, log));
+                }
+                return topics;
+            }
+
+        private:
+            TopicLog::ptr openLog(const std::string &topic_name, const std::string &dir)
+            {
+                auto log = TopicLog::open(dir, _options, std::bind(&TopicStore::notify, this));
+                if (!log)
+                    return log;
+                std::unique_lock<std::mutex> lock(_mutex);
+                _logs[topic_name] = log;
+                return log;
+            }
+
+            // 未落盘的数据过多，立即进行一次组提交
+            void notify()
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _notified = true;
+                }
+                _cond.notify_one();
+            }
+
+            void flushThread()
+            {
+                auto last_expire = std::chrono::steady_clock::now();
+                while (true)
+                {
+                    std::vector<TopicLog::ptr> logs;
+                    bool running = true;
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _cond.wait_for(lock, std::chrono::milliseconds(_options.flush_interval_ms),
+                                       [this]() { return _running == false || _notified; });
+                        _notified = false;
+                        running = _running;
+                        for (auto &it : _logs)
+                        {
+                            logs.push_back(it.second);
+                        }
+                    }
+                    for (auto &log : logs)
+                    {
+                        log->sync();
+                    }
+                    if (running == false)
+                        return; // 退出前已经完成最后一次落盘
+                    auto now = std::chrono::steady_clock::now();
+                    if (now - last_expire >= std::chrono::milliseconds(expireIntervalMs))
+                    {
+                        last_expire = now;
+                        for (auto &log : logs)
+                        {
+                            log->expire();
+                        }
+                    }
+                }
+            }
+
+            // 主题名称中可能包含任意字符，目录名使用十六进制编码
+            std::string topicDir(const std::string &topic_name)
+            {
+                static const char *hex = "0123456789abcdef";
+                std::string dir = _dir + "/topic_";
+                for (unsigned char c : topic_name)
+                {
+                    dir.push_back(hex[c >> 4]);
+                    dir.push_back(hex[c & 0x0F]);
+                }
+                return dir;
+            }
+
+            static bool writeMeta(const std::string &dir, const Json::Value &meta)
+            {
+                std::string body;
+                if (JSON::Serialize(meta, body) == false)
+                    return false;
+                std::string tmp = dir + "/meta.json.tmp";
+                int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd < 0)
+                {
+                    LOG(FATAL, "写入主题配置失败：%s\n", strerror(errno));
+                    return false;
+                }
+                bool ok = ::write(fd, body.data(), body.size()) == (ssize_t)body.size() && fsync(fd) == 0;
+                close(fd);
+                // 先写临时文件再改名，避免崩溃时留下不完整的配置
+                if (ok == false || ::rename(tmp.c_str(), (dir + "/meta.json").c_str()) != 0)
+                {
+                    LOG(FATAL, "写入主题配置失败：%s\n", strerror(errno));
+                    ::unlink(tmp.c_str());
+                    return false;
+                }
+                return true;
+            }
+
+            static bool readMeta(const std::string &dir, Json::Value &meta)
+            {
+                std::ifstream in(dir + "/meta.json", std::ios::binary);
+                if (in.is_open() == false)
+                    return false;
+                std::string body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                return JSON::UnSerialize(body, meta);
+            }
+        };
+    };
+};